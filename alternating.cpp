@@ -18,9 +18,61 @@
     along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <functional>
+#include <memory>
+#include <spot/tl/apcollect.hh>
 #include "utils.hpp"
 #include "alternating.hpp"
 
+// a loop of a clause C in DNF of psi: an edge of the conjunction of the states of C whose targets include C
+struct clause_loop {
+	std::set<unsigned> clause;
+	PartialEdge edge;
+};
+
+// returns the loops of the clauses in DNF of f, as LTL3BA computes them; the clauses with a state missing
+// are skipped as no edge can loop in them; nothing is added to the automaton
+static std::vector<clause_loop> clause_loops(VWAA* vwaa, spot::formula f) {
+	std::vector<clause_loop> result;
+
+	for (auto& clause : f_bar(f)) {
+		std::set<unsigned> states;
+		std::set<std::set<unsigned>> edges_sets;
+		for (auto& g : clause) {
+			if (!vwaa->state_exists(g)) {
+				states.clear();
+				break;
+			}
+			unsigned state = vwaa->get_state_id(g);
+			states.insert(state);
+			edges_sets.insert(vwaa->get_state_edges(state));
+		}
+		if (states.empty()) {
+			continue;
+		}
+
+		for (auto& edge : vwaa->product(edges_sets, true)) {
+			if (std::includes(edge.targets.begin(), edge.targets.end(), states.begin(), states.end())) {
+				result.push_back({ states, edge });
+			}
+		}
+	}
+
+	return result;
+}
+
+// returns the loop equal to the edge of psi, or nullptr; the edges of psi that come from other clauses
+// or from merging by domination only contain the states of a clause and are not its loops
+static const clause_loop* find_clause_loop(VWAA* vwaa, Edge* e, const std::vector<clause_loop>& loops) {
+	for (auto& loop : loops) {
+		if (loop.edge.targets == e->get_targets() && loop.edge.marks == e->get_marks()
+			&& vwaa->same_label(loop.edge.label, e->get_label())) {
+			return &loop;
+		}
+	}
+	return nullptr;
+}
+
 bool is_mergeable(VWAA* vwaa, spot::formula f) {
 	if (!f.is(spot::op::U)) {
 		throw "Argument of is_mergeable is not an U-formula";
@@ -39,27 +91,20 @@ bool is_mergeable(VWAA* vwaa, spot::formula f) {
 	// bdd of the left argument
 	auto alpha = spot::formula_to_bdd(f[0], vwaa->spot_bdd_dict, vwaa->spot_aut);
 	bool at_least_one_loop = false;
-	// for each conjunction in DNF of psi test whether loops are covered by alpha
-	for (auto& clause : f_bar(f[1])) {
-		// convert a set of formulae into their conjunction
-		auto sf = spot::formula::And(std::vector<spot::formula>(clause.begin(), clause.end()));
-		// create the state for the conjunction
-		unsigned state_id = make_alternating_recursive(vwaa, sf);
-		// Check that any loop label implies alpha(f[0])
-		for (auto& edge_id : vwaa->get_state_edges(state_id)) {
-			auto t = vwaa->get_edge(edge_id);
-			//check t is a loop
-			auto tar_states = t->get_targets();
-			std::set<spot::formula> targets;
-			for (auto& tar_state : tar_states) {
-				targets.insert(vwaa->state_name(tar_state));
-			}
-			if (std::includes(targets.begin(), targets.end(), clause.begin(), clause.end())) {
-				// If label does not satisfy alpha, return false
-				at_least_one_loop = true;
-				if ((t->get_label() & alpha) != t->get_label()) {
-					return false;
-				}
+
+	// the state of psi is needed by the translation of f anyway, its edges are the edges of
+	// the clauses in DNF of psi, so we test the loops there instead of creating a state for each clause
+	unsigned right = make_alternating_recursive(vwaa, f[1]);
+	auto loops = clause_loops(vwaa, f[1]);
+
+	// Check that any loop label implies alpha(f[0])
+	for (auto& edge_id : vwaa->get_state_edges(right)) {
+		auto t = vwaa->get_edge(edge_id);
+		if (find_clause_loop(vwaa, t, loops) != nullptr) {
+			// If label does not satisfy alpha, return false
+			at_least_one_loop = true;
+			if ((t->get_label() & alpha) != t->get_label()) {
+				return false;
 			}
 		}
 	}
@@ -73,6 +118,68 @@ bool is_mergeable(VWAA* vwaa, spot::formula f) {
 	return true;
 }
 
+// a suspendable formula holds on a word iff it holds on each of its suffixes,
+// so it is equivalent to X, F and G of itself (GFa, FGa, GFa & FGb, ...)
+static bool is_suspendable(spot::formula f) {
+	return f.is_eventual() && f.is_universal();
+}
+
+// splits the operands of an And or Or formula g into those moved out of a temporal operator and the others
+static void split_operands(spot::formula g, std::function<bool(spot::formula)> moved_out,
+	std::vector<spot::formula>& outer, std::vector<spot::formula>& inner) {
+	for (unsigned i = 0, size = g.size(); i < size; ++i) {
+		(moved_out(g[i]) ? outer : inner).push_back(g[i]);
+	}
+}
+
+// returns a formula equivalent to f where the suspendable subformulae (and for -G2 also the nested G and F)
+// are moved out of the temporal operator of f, or f itself if there is nothing to move;
+// the states of the moved subformulae are then shared instead of being spawned again by each loop of f
+static spot::formula merge_temporal(spot::formula f) {
+	if (o_g_merge_level == 0 || !(f.is(spot::op::X) || f.is(spot::op::U) || f.is(spot::op::R))) {
+		return f;
+	}
+
+	auto operand = f.is(spot::op::X) ? f[0] : f[1];
+
+	// X ψ, α U ψ and α R ψ are equivalent to a suspendable ψ
+	if (is_suspendable(operand)) {
+		return operand;
+	}
+
+	bool is_f = f.is(spot::op::U) && f[0].is_tt();
+	bool is_g = f.is(spot::op::R) && f[0].is_ff();
+
+	if (o_g_merge_level > 1) {
+		// F (α U ψ) = F ψ and G (α R ψ) = G ψ
+		if ((is_f && operand.is(spot::op::U)) || (is_g && operand.is(spot::op::R))) {
+			return spot::formula::binop(f.kind(), f[0], operand[1]);
+		}
+	}
+
+	// suspendable operands of a disjunction under U and of a conjunction under R or X are moved out,
+	// F (β | F ψ) = F β | F ψ and G (β & G ψ) = G β & G ψ are moved out for -G2
+	bool disjunctive = operand.is(spot::op::Or) && (f.is(spot::op::U) || f.is(spot::op::X));
+	bool conjunctive = operand.is(spot::op::And) && (f.is(spot::op::R) || f.is(spot::op::X));
+	if (!disjunctive && !conjunctive) {
+		return f;
+	}
+
+	std::vector<spot::formula> outer, inner;
+	split_operands(operand, [&](spot::formula g) {
+		return is_suspendable(g) || (o_g_merge_level > 1
+			&& ((is_f && g.is(spot::op::U) && g[0].is_tt()) || (is_g && g.is(spot::op::R) && g[0].is_ff())));
+	}, outer, inner);
+
+	if (outer.empty()) {
+		return f;
+	}
+
+	auto rest = spot::formula::multop(operand.kind(), inner);
+	outer.push_back(f.is(spot::op::X) ? spot::formula::X(rest) : spot::formula::binop(f.kind(), f[0], rest));
+	return spot::formula::multop(operand.kind(), outer);
+}
+
 void register_ap_from_boolean_formula(VWAA* slaa, spot::formula f) {
 	// recursively register APs from a state formula f
 	if (f.is(spot::op::And) || f.is(spot::op::Or)) {
@@ -84,119 +191,238 @@ void register_ap_from_boolean_formula(VWAA* slaa, spot::formula f) {
 	}
 }
 
-unsigned make_alternating_recursive(VWAA* slaa, spot::formula f) {
-	if (slaa->state_exists(f)) {
-		// we already have a state for f
-		return slaa->get_state_id(f);
-	} else {
-		// create a new state
-		unsigned state_id = slaa->get_state_id(f);
-
-		if (f.is_tt()) {
-			slaa->add_edge(state_id, bdd_true(), std::set<unsigned>());
-		} else if (f.is_ff()) {
-			// NOP
-		} else if (f.is_boolean()) {
-			// register APs in f
-			register_ap_from_boolean_formula(slaa, f);
-
-			// add the only edge to nowhere
-			slaa->add_edge(state_id, spot::formula_to_bdd(f, slaa->spot_bdd_dict, slaa->spot_aut), std::set<unsigned>());
-		} else if (f.is(spot::op::And)) {
-			std::set<std::set<unsigned>> conj_edges;
-			// create a state for each conjunct
-			for (unsigned i = 0, size = f.size(); i < size; ++i) {
-				conj_edges.insert(slaa->get_state_edges(make_alternating_recursive(slaa, f[i])));
+// returns the formulae whose states are used by the state of f, where merged = merge_temporal(f),
+// in the order in which they are built
+static std::vector<spot::formula> operands_of(spot::formula f, spot::formula merged) {
+	std::vector<spot::formula> result;
+	if (merged != f) {
+		result.push_back(merged);
+	} else if (f.is_boolean()) {
+		// NOP
+	} else if (f.is(spot::op::And) || f.is(spot::op::Or)) {
+		for (unsigned i = 0, size = f.size(); i < size; ++i) {
+			result.push_back(f[i]);
+		}
+	} else if (f.is(spot::op::X)) {
+		if (o_x_single_succ) {
+			result.push_back(f[0]);
+		} else {
+			for (auto& g_set : f_bar(f[0])) {
+				result.insert(result.end(), g_set.begin(), g_set.end());
 			}
-			// and add the product edges
-			auto product = slaa->product(conj_edges, true);
-			for (auto& edge : product) {
+		}
+	} else if (f.is(spot::op::R) || f.is(spot::op::U)) {
+		result.push_back(f[0]);
+		result.push_back(f[1]);
+	}
+	return result;
+}
+
+// adds the edges of the state of f, the states of its operands (see operands_of) are already built,
+// so the calls of make_alternating_recursive only look them up
+static void build_state(VWAA* slaa, spot::formula f, spot::formula merged, unsigned state_id) {
+	if (merged != f) {
+		// f is equivalent to merged, so it gets the edges of the state for merged
+		unsigned merged_id = make_alternating_recursive(slaa, merged);
+		unsigned checkpoint = slaa->edges_checkpoint();
+		for (auto& edge : slaa->get_state_edges(merged_id)) {
+			slaa->add_edge(state_id, edge);
+		}
+		slaa->release_scratch_edges(checkpoint, state_id);
+	} else if (f.is_tt()) {
+		slaa->add_edge(state_id, bdd_true(), std::set<unsigned>());
+	} else if (f.is_ff()) {
+		// NOP
+	} else if (f.is_boolean()) {
+		// register APs in f
+		register_ap_from_boolean_formula(slaa, f);
+
+		// add the only edge to nowhere
+		slaa->add_edge(state_id, spot::formula_to_bdd(f, slaa->spot_bdd_dict, slaa->spot_aut), std::set<unsigned>());
+	} else if (f.is(spot::op::And)) {
+		std::set<std::set<unsigned>> conj_edges;
+		// create a state for each conjunct
+		for (unsigned i = 0, size = f.size(); i < size; ++i) {
+			conj_edges.insert(slaa->get_state_edges(make_alternating_recursive(slaa, f[i])));
+		}
+		// and add the product edges
+		unsigned checkpoint = slaa->edges_checkpoint();
+		for (auto& edge : slaa->product(conj_edges, true)) {
+			slaa->add_edge(state_id, edge.label, edge.targets, edge.marks);
+		}
+		slaa->release_scratch_edges(checkpoint, state_id);
+	} else if (f.is(spot::op::Or)) {
+		// create a state for each disjunct
+		std::vector<unsigned> disjuncts;
+		for (unsigned i = 0, size = f.size(); i < size; ++i) {
+			disjuncts.push_back(make_alternating_recursive(slaa, f[i]));
+		}
+		// and add all their edges
+		unsigned checkpoint = slaa->edges_checkpoint();
+		for (auto& fi_state : disjuncts) {
+			for (auto& edge : slaa->get_state_edges(fi_state)) {
 				slaa->add_edge(state_id, edge);
 			}
-		} else if (f.is(spot::op::Or)) {
-			// create a state for each disjunct
-			for (unsigned i = 0, size = f.size(); i < size; ++i) {
-				auto fi_state_edges = slaa->get_state_edges(make_alternating_recursive(slaa, f[i]));
-				// and add all its edges
-				for (auto& edge : fi_state_edges) {
-					slaa->add_edge(state_id, edge);
+		}
+		slaa->release_scratch_edges(checkpoint, state_id);
+	} else if (f.is(spot::op::X)) {
+		if (o_x_single_succ) {
+			// translate X φ as (X φ) --tt--> (φ)
+			std::set<unsigned> target_set = { make_alternating_recursive(slaa, f[0]) };
+			slaa->add_edge(state_id, bdd_true(), target_set);
+		} else {
+			// we add an universal edge to all states in each disjunct
+			auto f_dnf = f_bar(f[0]);
+
+			for (auto& g_set : f_dnf) {
+				std::set<unsigned> target_set;
+				for (auto& g : g_set) {
+					target_set.insert(make_alternating_recursive(slaa, g));
 				}
-			}
-		} else if (f.is(spot::op::X)) {
-			if (o_x_single_succ) {
-				// translate X φ as (X φ) --tt--> (φ)
-				std::set<unsigned> target_set = { make_alternating_recursive(slaa, f[0]) };
 				slaa->add_edge(state_id, bdd_true(), target_set);
-			} else {
-				// we add an universal edge to all states in each disjunct
-				auto f_dnf = f_bar(f[0]);
-
-				for (auto& g_set : f_dnf) {
-					std::set<unsigned> target_set;
-					for (auto& g : g_set) {
-						target_set.insert(make_alternating_recursive(slaa, g));
-					}
-					slaa->add_edge(state_id, bdd_true(), target_set);
-				}
 			}
+		}
 
-		} else if (f.is(spot::op::R)) {
-			// we build automaton for f[0] even if we don't need it for G
-			// however, it doesn't cost much if f[0] == ff
-			// the advantage is that we don't break order of APs
-			unsigned left = make_alternating_recursive(slaa, f[0]);
-			unsigned right = make_alternating_recursive(slaa, f[1]);
+	} else if (f.is(spot::op::R)) {
+		// we build automaton for f[0] even if we don't need it for G
+		// however, it doesn't cost much if f[0] == ff
+		// the advantage is that we don't break order of APs
+		unsigned left = make_alternating_recursive(slaa, f[0]);
+		unsigned right = make_alternating_recursive(slaa, f[1]);
 
-			// using traditional construction until "end of construction"
-            std::set<unsigned> left_edges = slaa->get_state_edges(left);
-            std::set<unsigned> right_edges = slaa->get_state_edges(right);
+		// the loop and the products below are only copied to state_id
+		unsigned checkpoint = slaa->edges_checkpoint();
 
-            unsigned loop_id = slaa->create_edge(bdd_true());
-            slaa->get_edge(loop_id)->add_target(state_id);
+		// using traditional construction until "end of construction"
+        std::set<unsigned> left_edges = slaa->get_state_edges(left);
+        std::set<unsigned> right_edges = slaa->get_state_edges(right);
 
-            // remember the mark-discarding product should be used
-            for (auto& right_edge : right_edges) {
-                for (auto& left_edge : left_edges) {
-                    slaa->add_edge(state_id, slaa->edge_product(right_edge, left_edge, false));
-                }
-                slaa->add_edge(state_id, slaa->edge_product(right_edge, loop_id, false));
-			}
-            // "end of construction"
-		} else if (f.is(spot::op::U)) {
-			auto& ac = slaa->spot_aut->acc();
-			slaa->acc[f].fin = ac.add_set(); // create a new mark
-			slaa->acc[f].inf = -1U; // default value for Inf-mark, meaning the mark does not have a value
+        unsigned loop_id = slaa->create_edge(bdd_true());
+        slaa->get_edge(loop_id)->add_target(state_id);
 
-			unsigned left = make_alternating_recursive(slaa, f[0]);
-			unsigned right = make_alternating_recursive(slaa, f[1]);
+        // remember the mark-discarding product should be used
+        for (auto& right_edge : right_edges) {
+            for (auto& left_edge : left_edges) {
+                slaa->add_edge(state_id, slaa->edge_product(right_edge, left_edge, false));
+            }
+            slaa->add_edge(state_id, slaa->edge_product(right_edge, loop_id, false));
+		}
+        // "end of construction"
 
+		slaa->release_scratch_edges(checkpoint, state_id);
+	} else if (f.is(spot::op::U)) {
+		// the mark of f was created by make_alternating_recursive
+		unsigned left = make_alternating_recursive(slaa, f[0]);
+		unsigned right = make_alternating_recursive(slaa, f[1]);
 
-            //using traditional construction until "end of construction"
-            std::set<unsigned> left_edges = slaa->get_state_edges(left);
-            std::set<unsigned> right_edges = slaa->get_state_edges(right);
+		// the loop and the products below are only copied to state_id, is_mergeable creates no states
+		unsigned checkpoint = slaa->edges_checkpoint();
 
-            unsigned loop_id = slaa->create_edge(bdd_true());
-            slaa->get_edge(loop_id)->add_target(state_id);
+        //using traditional construction until "end of construction"
+        std::set<unsigned> left_edges = slaa->get_state_edges(left);
+        std::set<unsigned> right_edges = slaa->get_state_edges(right);
 
-            slaa->add_edge(state_id, right_edges);
+        unsigned loop_id = slaa->create_edge(bdd_true());
+        slaa->get_edge(loop_id)->add_target(state_id);
 
-            for (auto& left_edge : left_edges) {
-                auto p = slaa->edge_product(left_edge, loop_id, true);
-                // the only mark is the new Fin
-                slaa->get_edge(p)->clear_marks();
-                slaa->get_edge(p)->add_mark(slaa->acc[f].fin);
-                slaa->add_edge(state_id, p);
+        // with -m, is_mergeable reports the first mergeable U and exits
+        if ((o_u_merge_level > 0 || o_mergeable_info) && is_mergeable(slaa, f)) {
+            // alpha-merging of LTL3BA: a loop of psi in its clause C is labelled by a subset of alpha
+            // and C implies psi, so the loop can go to f instead and the states of C are not needed
+            auto loops = clause_loops(slaa, f[1]);
+
+            for (auto& right_edge : right_edges) {
+                auto e = slaa->get_edge(right_edge);
+                auto loop = find_clause_loop(slaa, e, loops);
+
+                if (loop == nullptr) {
+                    slaa->add_edge(state_id, right_edge);
+                    continue;
+                }
+
+                // the states of the clause are replaced with f, the other targets stay
+                std::set<unsigned> merged_targets = { state_id };
+                for (auto& target : e->get_targets()) {
+                    if (loop->clause.count(target) == 0) {
+                        merged_targets.insert(target);
+                    }
+                }
+
+                slaa->add_edge(state_id, e->get_label(), merged_targets, e->get_marks());
             }
-			// end of construction
+        } else {
+            slaa->add_edge(state_id, right_edges);
+        }
+
+        for (auto& left_edge : left_edges) {
+            auto p = slaa->edge_product(left_edge, loop_id, true);
+            // the only mark is the new Fin
+            slaa->get_edge(p)->clear_marks();
+            slaa->get_edge(p)->add_mark(slaa->acc[f].fin);
+            slaa->add_edge(state_id, p);
+        }
+		// end of construction
+
+		slaa->release_scratch_edges(checkpoint, state_id);
+	}
+}
+
+unsigned make_alternating_recursive(VWAA* slaa, spot::formula f) {
+	// a post-order traversal of the formula DAG with an explicit stack, so that the depth of the formula
+	// does not matter; like in a recursive construction, the state (and the mark of a U-formula) of f
+	// is created before those of its operands, and its edges after theirs
+	struct pending {
+		spot::formula f;
+		spot::formula merged;
+		bool expanded;
+	};
+	std::vector<pending> stack = { { f, f, false } };
+
+	while (!stack.empty()) {
+		if (stack.back().expanded) {
+			pending top = stack.back();
+			stack.pop_back();
+			build_state(slaa, top.f, top.merged, slaa->get_state_id(top.f));
+			continue;
+		}
+
+		spot::formula g = stack.back().f;
+		if (slaa->state_exists(g)) {
+			// we already have a state for g
+			stack.pop_back();
+			continue;
 		}
 
-		return state_id;
+		// create a new state
+		slaa->get_state_id(g);
+		spot::formula merged = merge_temporal(g);
+		if (merged == g && g.is(spot::op::U)) {
+			auto& ac = slaa->spot_aut->acc();
+			slaa->acc[g].fin = ac.add_set(); // create a new mark
+			slaa->acc[g].inf = -1U; // default value for Inf-mark, meaning the mark does not have a value
+		}
+		stack.back().merged = merged;
+		stack.back().expanded = true;
+
+		// the first operand is on the top of the stack
+		auto operands = operands_of(g, merged);
+		for (auto it = operands.rbegin(); it != operands.rend(); ++it) {
+			stack.push_back({ *it, *it, false });
+		}
 	}
+
+	return slaa->get_state_id(f);
 }
 
 VWAA* make_alternating(spot::formula f) {
 	VWAA* vwaa = new VWAA(f);
 
+	if (!o_assume.is_tt()) {
+		std::unique_ptr<spot::atomic_prop_set> aps(spot::atomic_prop_collect(f));
+		std::vector<spot::formula> ap_list(aps->begin(), aps->end());
+		vwaa->set_assumption(assumption_bdd(vwaa->spot_bdd_dict, ap_list, vwaa->spot_aut.get()));
+	}
+
 	if (o_single_init_state) {
 		std::set<unsigned> init_set = { make_alternating_recursive(vwaa, f) };
 		vwaa->add_init_set(init_set);
@@ -0,0 +1,141 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANTICHAIN_H
+#define ANTICHAIN_H
+#include <algorithm>
+#include <ostream>
+#include <vector>
+#include "bitset.hpp"
+
+// a positive Boolean formula over states given by the antichain of its minimal satisfying sets,
+// that is a disjunction of conjunctions of states where no conjunction is a subset of another;
+// false has no sets, true has just the empty set; the sets are kept sorted, so that equal
+// formulae have equal antichains and the comparison and hashing need no BDD
+class Antichain {
+protected:
+	std::vector<BitSet> sets;
+
+	// adds a set unless it is subsumed, removes the sets it subsumes; the order is restored by sort()
+	void add(const BitSet& set) {
+		for (auto& other : sets) {
+			if (other.is_subset_of(set)) {
+				return;
+			}
+		}
+		sets.erase(std::remove_if(sets.begin(), sets.end(), [&](const BitSet& other) {
+			return set.is_subset_of(other);
+		}), sets.end());
+		sets.push_back(set);
+	}
+
+	void sort() {
+		std::sort(sets.begin(), sets.end());
+	}
+
+public:
+	// false
+	Antichain() {}
+
+	// the conjunction of the states of the set (true for an empty one)
+	explicit Antichain(const BitSet& set) : sets({ set }) {}
+
+	bool is_false() const {
+		return sets.empty();
+	}
+
+	bool is_true() const {
+		return sets.size() == 1 && sets[0].empty();
+	}
+
+	Antichain operator|(const Antichain& other) const {
+		Antichain result = *this;
+		for (auto& set : other.sets) {
+			result.add(set);
+		}
+		result.sort();
+		return result;
+	}
+
+	Antichain operator&(const Antichain& other) const {
+		Antichain result;
+		for (auto& set : sets) {
+			for (auto& other_set : other.sets) {
+				result.add(set | other_set);
+			}
+		}
+		result.sort();
+		return result;
+	}
+
+	// removes the given states from all sets, that is replaces them with true
+	Antichain without(const BitSet& states) const {
+		Antichain result;
+		for (auto& set : sets) {
+			result.add(set - states);
+		}
+		result.sort();
+		return result;
+	}
+
+	// the states occurring in all sets, that is the states implied by the formula
+	BitSet implied(unsigned size) const {
+		if (sets.empty()) {
+			return BitSet(size);
+		}
+		BitSet result = sets[0];
+		for (auto& set : sets) {
+			result &= set;
+		}
+		return result;
+	}
+
+	const std::vector<BitSet>& get_sets() const {
+		return sets;
+	}
+
+	bool operator==(const Antichain& other) const {
+		return sets == other.sets;
+	}
+
+	bool operator!=(const Antichain& other) const {
+		return sets != other.sets;
+	}
+
+	size_t hash() const {
+		size_t h = sets.size();
+		for (auto& set : sets) {
+			h ^= set.hash() + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		}
+		return h;
+	}
+};
+
+// prints the antichain as {1,2} | {3}
+inline std::ostream& operator<<(std::ostream& out, const Antichain& a) {
+	if (a.is_false()) {
+		return out << "false";
+	}
+	for (unsigned i = 0; i < a.get_sets().size(); ++i) {
+		out << (i == 0 ? "" : " | ") << a.get_sets()[i];
+	}
+	return out;
+}
+
+#endif
@@ -26,6 +26,9 @@ template class Automaton<unsigned>;
 // Print handler for bdd_allsat
 // Taken from LTL3BA source: https://sourceforge.net/projects/ltl3ba/
 bool print_or = false;
+// the HOA index of the atomic proposition of each BDD variable, the variables are not numbered in the order
+// of the APs (the APs of --assume are registered first)
+std::vector<int> print_ap_of_var;
 void allsatPrintHandler(char* varset, int size) {
 	if (print_or) {
 		std::cout << " | ";
@@ -44,7 +47,7 @@ void allsatPrintHandler(char* varset, int size) {
 		if (varset[v] == 0) {
 			std::cout << "!";
 		}
-		std::cout << v;
+		std::cout << print_ap_of_var[v];
 		print_and = true;
 	}
 	if (!print_and) {
@@ -56,16 +59,12 @@ void allsatPrintHandler(char* varset, int size) {
 }
 
 template<typename T> unsigned Automaton<T>::get_state_id(T f) {
-	unsigned size = states.size();
-	for (unsigned i = 0; i < size; ++i) {
-		if (states[i] == f) {
-			return i;
-		}
+	auto it = state_ids.emplace(f, states.size()).first;
+	if (it->second == states.size()) {
+		states.push_back(f);
+		state_edges.push_back(std::set<unsigned>());
 	}
-
-	states.push_back(f);
-	state_edges.push_back(std::set<unsigned>());
-	return size;
+	return it->second;
 }
 
 template<typename T> T Automaton<T>::state_name(unsigned state_id) {
@@ -74,7 +73,7 @@ template<typename T> T Automaton<T>::state_name(unsigned state_id) {
 
 // CLion might think there are some problems with this. Do not worry, it is fine.
 template<typename T> bool Automaton<T>::state_exists(T f) {
-	return find(states.begin(), states.end(), f) != states.end();
+	return state_ids.count(f) > 0;
 }
 
 template<typename T> unsigned Automaton<T>::states_count() {
@@ -88,10 +87,20 @@ template<typename T> unsigned Automaton<T>::create_edge(bdd label) {
 	return edges.size() - 1;
 }
 
+template<typename T> void Automaton<T>::set_assumption(bdd a) {
+	assumption = a;
+}
+
+template<typename T> bool Automaton<T>::same_label(bdd a, bdd b) const {
+	return bdd_and(bdd_xor(a, b), assumption) == bddfalse;
+}
+
 template<typename T> void Automaton<T>::add_edge(unsigned from, bdd label, std::set<unsigned> to, std::set<acc_mark> marks) {
-	if (label == bddfalse) {
+	// the label does not matter for the letters that cannot occur
+	if (bdd_and(label, assumption) == bddfalse) {
 		return;
 	}
+	label = bdd_simplify(label, assumption);
 
 	unsigned edge_id = create_edge(label);
 
@@ -246,35 +255,134 @@ template<typename T> unsigned Automaton<T>::edge_product(unsigned e1, unsigned e
 	return edges.size() - 1;
 }
 
-// returns a set of edges in the product
-template<typename T> std::set<unsigned> Automaton<T>::product(std::set<std::set<unsigned>> edges_sets, bool preserve_ixsets) {
+template<typename T> unsigned Automaton<T>::edges_checkpoint() const {
+	return edges.size();
+}
+
+template<typename T> void Automaton<T>::release_scratch_edges(unsigned checkpoint, unsigned state_id) {
+	std::set<unsigned> used;
+	unsigned kept = checkpoint;
+	for (unsigned e = checkpoint; e < edges.size(); ++e) {
+		if (state_edges[state_id].count(e) > 0) {
+			edges[kept] = edges[e];
+			used.insert(kept);
+			++kept;
+		} else {
+			delete edges[e];
+		}
+	}
+	edges.resize(kept);
+
+	// the older edges of the state keep their numbers
+	for (auto e : state_edges[state_id]) {
+		if (e < checkpoint) {
+			used.insert(e);
+		}
+	}
+	state_edges[state_id] = used;
+}
+
+// checks whether the partial product p1 kills p2 in the sense of case 3 of Edge::dominates
+static bool partial_dominates(const PartialEdge& p1, const PartialEdge& p2, const std::set<acc_mark>& inf_marks) {
+	if (!std::includes(p2.targets.begin(), p2.targets.end(), p1.targets.begin(), p1.targets.end())
+		|| (p2.label & bdd_not(p1.label)) != bdd_false()) {
+		return false;
+	}
+
+	// each not-Inf mark in J1 has to be in J2
+	for (auto mark : p1.marks) {
+		if (inf_marks.count(mark) == 0 && p2.marks.count(mark) == 0) {
+			return false;
+		}
+	}
+
+	// and each Inf mark in J2 has to be in J1
+	for (auto mark : p2.marks) {
+		if (inf_marks.count(mark) > 0 && p1.marks.count(mark) == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// returns the products of edges
+template<typename T> std::vector<PartialEdge> Automaton<T>::product(const std::set<std::set<unsigned>>& edges_sets, bool preserve_ixsets) {
+	std::vector<PartialEdge> result;
+
 	if (edges_sets.empty()) {
 		// this is not a correct value for product of empty set
 		// in NA, a ∅ state is true and should contain a loop
 		// however, a source state is not an argument of product
 		// so we have to handle this outside of this method
-		return std::set<unsigned>();
+		return result;
 	}
 
-	auto s0 = *(edges_sets.begin());
+	// the domination of add_edge is applied to partial products too: if p1 kills p2,
+	// then p1 * e kills p2 * e for every edge e, so p2 can be dropped right away
+	bool prune_dominated = o_vwaa_determ && spot_id_to_vwaa_set == nullptr;
+	auto inf = get_inf_marks();
 
-	if (edges_sets.size() == 1) {
-		return s0;
-	}
+	// we start with the neutral element and multiply by one set of edges at a time
+	result.push_back({ bdd_true(), std::set<unsigned>(), std::set<acc_mark>() });
+
+	for (auto& edges_set : edges_sets) {
+		std::vector<PartialEdge> next;
+
+		for (auto& partial : result) {
+			for (auto& edge_id : edges_set) {
+				Edge* e = edges[edge_id];
+
+				PartialEdge p = { partial.label & e->get_label(), partial.targets, partial.marks };
+				if (p.label == bdd_false()) {
+					continue;
+				}
+
+				auto targets = e->get_targets();
+				p.targets.insert(targets.begin(), targets.end());
+				if (preserve_ixsets) {
+					auto marks = e->get_marks();
+					p.marks.insert(marks.begin(), marks.end());
+				}
 
-	edges_sets.erase(edges_sets.begin());
-	auto s1 = product(edges_sets, preserve_ixsets);
+				// a product with the same targets and marks only extends the label of the existing one
+				bool merged = false;
+				for (auto& other : next) {
+					if (other.targets == p.targets && other.marks == p.marks) {
+						other.label |= p.label;
+						merged = true;
+						break;
+					}
+				}
+				if (merged) {
+					continue;
+				}
 
-	std::set<unsigned> result;
+				if (prune_dominated) {
+					bool killed = false;
+					for (auto& other : next) {
+						if (partial_dominates(other, p, inf)) {
+							killed = true;
+							break;
+						}
+					}
+					if (killed) {
+						continue;
+					}
 
-	for (auto& e0 : s0) {
-		for (auto& e1 : s1) {
+					next.erase(std::remove_if(next.begin(), next.end(), [&](const PartialEdge& other) {
+						return partial_dominates(p, other, inf);
+					}), next.end());
+				}
 
-			unsigned p = edge_product(e0, e1, preserve_ixsets);
-			if (get_edge(p)->get_label() != bdd_false()) {
-				result.insert(p);
+				next.push_back(p);
 			}
 		}
+
+		result.swap(next);
+		if (result.empty()) {
+			break;
+		}
 	}
 
 	return result;
@@ -376,6 +484,11 @@ template<typename T> void Automaton<T>::remove_unreachable_states() {
 
 	states = new_state_table;
 	state_edges = new_state_edges_table;
+
+	state_ids.clear();
+	for (unsigned state_id = 0; state_id < conv_table_size; ++state_id) {
+		state_ids[states[state_id]] = state_id;
+	}
 }
 
 // removes all marks on non-loops
@@ -390,6 +503,96 @@ void VWAA::remove_unnecessary_marks() {
 	}
 }
 
+// the signature of a state is the set of its edges, where each edge is described
+// by the ID of its label, its marks and the set of blocks of its targets
+// two states stay in the same block iff they had the same block and signature
+void VWAA::merge_equivalent_states() {
+	typedef std::set<std::tuple<int, std::set<acc_mark>, std::set<unsigned>>> state_signature;
+
+	unsigned states_size = states.size();
+	if (states_size < 2) {
+		return;
+	}
+
+	// we start with all states in a single block
+	std::vector<unsigned> block(states_size, 0);
+	unsigned blocks_count = 1;
+
+	while (true) {
+		std::map<std::pair<unsigned, state_signature>, unsigned> new_blocks;
+		std::vector<unsigned> new_block(states_size);
+
+		for (unsigned state_id = 0; state_id < states_size; ++state_id) {
+			state_signature signature;
+			for (auto& edge_id : state_edges[state_id]) {
+				auto edge = get_edge(edge_id);
+
+				std::set<unsigned> target_blocks;
+				for (auto& target_id : edge->get_targets()) {
+					target_blocks.insert(block[target_id]);
+				}
+
+				signature.insert(std::make_tuple(edge->get_label().id(), edge->get_marks(), target_blocks));
+			}
+
+			auto key = std::make_pair(block[state_id], signature);
+			auto it = new_blocks.find(key);
+			if (it == new_blocks.end()) {
+				it = new_blocks.insert(std::make_pair(key, new_blocks.size())).first;
+			}
+			new_block[state_id] = it->second;
+		}
+
+		block = new_block;
+
+		// blocks are only ever split, so the same count means a fixpoint
+		if (new_blocks.size() == blocks_count) {
+			break;
+		}
+		blocks_count = new_blocks.size();
+	}
+
+	if (blocks_count == states_size) {
+		// nothing to merge
+		return;
+	}
+
+	// the first state of each block represents it, but the state for true is preferred:
+	// print_hoaf names it "t" like the virtual sink, so make_semideterministic finds it as the state t
+	std::vector<unsigned> representative(blocks_count, -1U);
+	for (unsigned state_id = 0; state_id < states_size; ++state_id) {
+		if (representative[block[state_id]] == -1U || states[state_id].is_tt()) {
+			representative[block[state_id]] = state_id;
+		}
+	}
+
+	// retarget every edge and initial configuration to representatives
+	for (unsigned state_id = 0; state_id < states_size; ++state_id) {
+		for (auto& edge_id : state_edges[state_id]) {
+			auto edge = get_edge(edge_id);
+
+			std::set<unsigned> new_target_set;
+			for (auto& target_id : edge->get_targets()) {
+				new_target_set.insert(representative[block[target_id]]);
+			}
+			edge->replace_target_set(new_target_set);
+		}
+	}
+
+	std::set<std::set<unsigned>> new_init_sets;
+	for (auto& init_set : init_sets) {
+		std::set<unsigned> new_init_set;
+		for (auto& init_state : init_set) {
+			new_init_set.insert(representative[block[init_state]]);
+		}
+		new_init_sets.insert(new_init_set);
+	}
+	init_sets = new_init_sets;
+
+	// the merged states are not reachable anymore
+	remove_unreachable_states();
+}
+
 VWAA::ac_representation VWAA::mark_transformation(std::map<acc_mark, unsigned>& tgba_mark_owners) {
 	// get a set of all Inf marks; also remember marks having escaping Inf
 	std::map<acc_mark, bool> inf_marks;
@@ -547,7 +750,19 @@ VWAA::ac_representation VWAA::mark_transformation(std::map<acc_mark, unsigned>&
 	return acr;
 }
 
-void VWAA::print_hoaf() {
+const std::string& VWAA::formula_label(spot::formula f) {
+	auto it = formula_labels.find(f);
+	if (it == formula_labels.end()) {
+		// the simplifier keeps its caches for all automata
+		static spot::tl_simplifier simp;
+		std::ostringstream label;
+		label << spot::unabbreviate(simp.simplify(f), "WM");
+		it = formula_labels.emplace(f, label.str()).first;
+	}
+	return it->second;
+}
+
+void VWAA::print_hoaf(bool names) {
     bool sink_state_needed = false;
     bool true_state_exists = false;
     unsigned sink_state_id;
@@ -577,18 +792,25 @@ void VWAA::print_hoaf() {
         sink_state_id = state_counter;
     }
 
-    spot::tl_simplifier simp;
-
     std::cout << "HOA: v1\n";
     std::cout << "tool: \"LTL2SDBA\"\n";
-    std::cout << "name: \"Automaton for " << spot::unabbreviate(simp.simplify(phi), "WM") << "\"\n";
+    if (names) {
+        std::cout << "name: \"Automaton for " << formula_label(phi) << "\"\n";
+    }
     std::cout << "States: " << (sink_state_needed ? state_counter + 1 : state_counter) << '\n'; // + 1 is for sink state
 
     auto bdd_dict = spot_aut->ap();
     unsigned bdd_dict_size = bdd_dict.size();
     std::cout << "AP: " << bdd_dict_size;
+    print_ap_of_var.clear();
     for (unsigned i = 0; i < bdd_dict_size; ++i) {
         std::cout << " \"" << bdd_dict[i] << '"';
+
+        unsigned var = spot_bdd_dict->varnum(bdd_dict[i]);
+        if (var >= print_ap_of_var.size()) {
+            print_ap_of_var.resize(var + 1, -1);
+        }
+        print_ap_of_var[var] = i;
     }
     std::cout << '\n';
 
@@ -603,7 +825,7 @@ void VWAA::print_hoaf() {
             std::cout << target_id;
             target_printed = true;
         }
-        std::cout << std::endl;
+        std::cout << '\n';
     }
 
     // acceptance condition
@@ -612,7 +834,14 @@ void VWAA::print_hoaf() {
 
     std::cout << "\n--BODY--\n";
     for (unsigned state_id = 0, state_count = states.size(); state_id < state_count; ++state_id) {
-        std::cout << "State: " << state_id << " \"" << spot::unabbreviate(simp.simplify(states[state_id]), "WM") << "\"\n";
+        std::cout << "State: " << state_id;
+        if (states[state_id].is_tt()) {
+            // the state for true is the sink, it is named like the virtual one in any case
+            std::cout << " \"t\"";
+        } else if (names) {
+            std::cout << " \"" << formula_label(states[state_id]) << '"';
+        }
+        std::cout << '\n';
         // for every edge of this state
         for (auto& edge_id : state_edges[state_id]) {
             Edge* edge = edges[edge_id];
@@ -666,7 +895,33 @@ void VWAA::print_hoaf() {
     std::cout << "--END--\n";
 }
 
-void VWAA::print_dot() {
+void VWAA::print_binary() {
+	binaut_writer writer(spot_aut->ap(), spot_bdd_dict, spot_aut->acc().num_sets(), spot_aut->acc().get_acceptance());
+
+	for (auto& init_set : init_sets) {
+		writer.add_init(std::vector<unsigned>(init_set.begin(), init_set.end()));
+	}
+
+	// edges with the empty set of targets are kept, the reader adds a sink state for them
+	for (unsigned state_id = 0, state_count = states.size(); state_id < state_count; ++state_id) {
+		writer.add_state();
+		for (auto& edge_id : state_edges[state_id]) {
+			Edge* edge = edges[edge_id];
+
+			uint32_t marks = 0;
+			for (auto& mark : edge->get_marks()) {
+				marks |= uint32_t(1) << mark;
+			}
+
+			auto targets = edge->get_targets();
+			writer.add_edge(edge->get_label(), std::vector<unsigned>(targets.begin(), targets.end()), marks);
+		}
+	}
+
+	writer.write(std::cout);
+}
+
+void VWAA::print_dot(bool names) {
 	std::cout << "digraph G {\n\trankdir=LR\n";
 
 	std::string init_state_style("[label=\"\", style=invis, width=0]");
@@ -701,13 +956,15 @@ void VWAA::print_dot() {
 		++init_i;
 	}
 
-	spot::tl_simplifier simp;
-
 	// through every state
 	unsigned int empty_targets_ct = 0;
 	for (unsigned state_id = 0, state_count = states.size(); state_id < state_count; ++state_id) {
 		// print state
-		std::cout << "\t" << state_id << " [label=\"" << state_id << " | " << spot::unabbreviate(simp.simplify(states[state_id]), "WM") << "\", peripheries=1]\n";
+		std::cout << "\t" << state_id << " [label=\"" << state_id;
+		if (names) {
+			std::cout << " | " << formula_label(states[state_id]);
+		}
+		std::cout << "\", peripheries=1]\n";
 
 		// and its edges
 		auto edges = get_state_edges(state_id);
@@ -25,6 +25,8 @@
 #include <stack>
 #include <string>
 #include <sstream>
+#include <tuple>
+#include <unordered_map>
 #include <spot/tl/print.hh>
 #include <queue>
 #include <vector>
@@ -39,6 +41,7 @@
 #include <spot/twaalgos/simulation.hh>
 #include <spot/twaalgos/sccfilter.hh>
 #include "utils.hpp"
+#include "binaut.hpp"
 #include <iostream>
 #include <fstream>
 
@@ -93,11 +96,21 @@ public:
 	int dominates(Edge* other, std::set<acc_mark> inf_marks) const;
 };
 
+// a product of edges that is not stored in the automaton yet
+struct PartialEdge {
+	bdd label;
+	std::set<unsigned> targets;
+	std::set<acc_mark> marks;
+};
+
 template<typename T> class Automaton {
 protected:
 	// vector of names of states
 	std::vector<T> states;
 
+	// the ID of each name in `states'
+	std::unordered_map<T, unsigned> state_ids;
+
 	// vector of edges
 	std::vector<Edge*> edges;
 
@@ -112,6 +125,9 @@ protected:
 	// the set of initial configurations
 	std::set<std::set<unsigned>> init_sets;
 
+	// the letters that can occur (--assume), labels are simplified with respect to it
+	bdd assumption = bddtrue;
+
 public:
 	// returns a state ID by its name, possibly creating a new one
 	unsigned get_state_id(T f);
@@ -125,6 +141,12 @@ public:
 	// returns the number of states
 	unsigned states_count();
 
+	// sets the letters that can occur, edges added later are labelled only up to them
+	void set_assumption(bdd a);
+
+	// checks whether the labels a and b agree on the letters that can occur
+	bool same_label(bdd a, bdd b) const;
+
 	// creates an edge and returns its ID (index in the `edges' set)
 	unsigned create_edge(bdd label);
 
@@ -159,9 +181,18 @@ public:
 	// returns an edge ID that is a (mark-preserving or mark-discarding) product of given edges
 	unsigned edge_product(unsigned e1, unsigned e2, bool preserve_mark_sets);
 
+	// returns the number of edges created so far, a checkpoint for release_scratch_edges
+	unsigned edges_checkpoint() const;
+
+	// deletes the edges created since the checkpoint that are not used by the state (products and loops
+	// only built to be copied, edges killed by domination) and renumbers the others;
+	// no other state may have got an edge since the checkpoint
+	void release_scratch_edges(unsigned checkpoint, unsigned state_id);
+
 	// for the family of sets { M_1, ..., M_n } of edges,
-	// returns set of products of each n edges from distinct M_i
-	std::set<unsigned> product(std::set<std::set<unsigned>> edges_sets, bool preserve_mark_sets);
+	// returns products of each n edges from distinct M_i; the products are built one factor at a time
+	// and partial products with false labels, equal to or (for -d1) dominated by others are dropped early
+	std::vector<PartialEdge> product(const std::set<std::set<unsigned>>& edges_sets, bool preserve_mark_sets);
 
 	~Automaton();
 };
@@ -170,6 +201,12 @@ class VWAA : public Automaton<spot::formula> {
 protected:
 	spot::formula phi;
 
+	// printed names of the formulae of states, see formula_label
+	std::unordered_map<spot::formula, std::string> formula_labels;
+
+	// returns the simplified formula f as printed in the names of states, computed once for each formula
+	const std::string& formula_label(spot::formula f);
+
 public:
 	// each U-subformula has its own acceptance condition
 	// (Fin(x) & (Fin(y_1) | ... | Fin(y_i))
@@ -202,6 +239,10 @@ public:
 	// removes marks from non-looping transitions
 	void remove_unnecessary_marks();
 
+	// merges states with equivalent outgoing edges (equal labels and marks,
+	// targets modulo the partition) by partition refinement
+	void merge_equivalent_states();
+
 	// returns a set of initial configurations
 	std::set<std::set<unsigned>> get_init_sets() const;
 
@@ -213,14 +254,17 @@ public:
 	// such that all loops over q contain j as the only mark
 	ac_representation mark_transformation(std::map<acc_mark, unsigned>& tgba_mark_owners);
 
-	// prints the automaton in HOA format
-	void print_hoaf();
+	// prints the automaton in HOA format, without names of states (except the sink state t) if names is false
+	void print_hoaf(bool names = true);
 
     // prints the automaton in HOA format into file
     void printfile_hoaf();
 
-	// prints the automaton in DOT format
-	void print_dot();
+	// prints the automaton in DOT format, states are labelled only by their numbers if names is false
+	void print_dot(bool names = true);
+
+	// prints the automaton in the binary format of binaut.hpp
+	void print_binary();
 
 	VWAA(spot::formula f);
 };
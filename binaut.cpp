@@ -0,0 +1,392 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <set>
+#include <sstream>
+#include <tuple>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <spot/misc/minato.hh>
+#include <spot/tl/parse.hh>
+#include "binaut.hpp"
+
+static const uint32_t binaut_magic = 0x4244534c; // "LSDB" read as a little-endian number
+static const uint32_t binaut_version = 1;
+
+// the sizes in bytes are rounded up to whole numbers
+static uint32_t padded_words(uint32_t bytes) {
+	return (bytes + 3) / 4;
+}
+
+binaut_writer::binaut_writer(const std::vector<spot::formula>& ap_list, const spot::bdd_dict_ptr& dict,
+	unsigned num_acc_sets, const spot::acc_cond::acc_code& acc) : num_acc_sets(num_acc_sets) {
+	for (unsigned i = 0; i < ap_list.size(); ++i) {
+		std::ostringstream name;
+		name << ap_list[i];
+		aps.push_back(name.str());
+
+		unsigned var = dict->varnum(ap_list[i]);
+		if (var >= ap_of_var.size()) {
+			ap_of_var.resize(var + 1, -1);
+		}
+		ap_of_var[var] = i;
+	}
+
+	std::ostringstream text;
+	acc.to_text(text);
+	acceptance = text.str();
+}
+
+void binaut_writer::add_init(const std::vector<unsigned>& init_set) {
+	init_targets.insert(init_targets.end(), init_set.begin(), init_set.end());
+	init_offsets.push_back(init_targets.size());
+}
+
+void binaut_writer::add_state() {
+	state_offsets.push_back(state_offsets.back());
+}
+
+void binaut_writer::add_edge(bdd label, const std::vector<unsigned>& edge_targets, uint32_t edge_marks) {
+	++state_offsets.back();
+
+	targets.insert(targets.end(), edge_targets.begin(), edge_targets.end());
+	target_offsets.push_back(targets.size());
+	marks.push_back(edge_marks);
+
+	// the label is stored as an irredundant sum of products
+	spot::minato_isop isop(label);
+	bdd cube;
+	while ((cube = isop.next()) != bddfalse) {
+		while (cube != bddtrue) {
+			uint32_t ap = ap_of_var[bdd_var(cube)];
+			if (bdd_high(cube) == bddfalse) {
+				literals.push_back(2 * ap + 1);
+				cube = bdd_low(cube);
+			} else {
+				literals.push_back(2 * ap);
+				cube = bdd_high(cube);
+			}
+		}
+		literal_offsets.push_back(literals.size());
+	}
+	cube_offsets.push_back(literal_offsets.size() - 1);
+}
+
+void binaut_writer::write(std::ostream& out) const {
+	std::string names;
+	std::vector<uint32_t> ap_offsets = { 0 };
+	for (auto& ap : aps) {
+		names += ap;
+		ap_offsets.push_back(names.size());
+	}
+
+	binaut_header header;
+	header.magic = binaut_magic;
+	header.version = binaut_version;
+	header.num_aps = aps.size();
+	header.ap_names_size = names.size();
+	header.num_inits = init_offsets.size() - 1;
+	header.num_init_targets = init_targets.size();
+	header.num_states = state_offsets.size() - 1;
+	header.num_edges = marks.size();
+	header.num_targets = targets.size();
+	header.num_cubes = literal_offsets.size() - 1;
+	header.num_literals = literals.size();
+	header.num_acc_sets = num_acc_sets;
+	header.acceptance_size = acceptance.size();
+
+	auto write_words = [&out](const std::vector<uint32_t>& words) {
+		out.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint32_t));
+	};
+	auto write_padded = [&out](const std::string& s) {
+		out.write(s.data(), s.size());
+		out.write("\0\0\0", padded_words(s.size()) * 4 - s.size());
+	};
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	write_words(ap_offsets);
+	write_padded(names);
+	write_words(init_offsets);
+	write_words(init_targets);
+	write_words(state_offsets);
+	write_words(target_offsets);
+	write_words(cube_offsets);
+	write_words(marks);
+	write_words(targets);
+	write_words(literal_offsets);
+	write_words(literals);
+	write_padded(acceptance);
+}
+
+void print_binary(std::ostream& out, const spot::const_twa_graph_ptr& aut) {
+	binaut_writer writer(aut->ap(), aut->get_dict(), aut->num_sets(), aut->get_acceptance());
+
+	auto init = aut->univ_dests(aut->get_init_state_number());
+	writer.add_init(std::vector<unsigned>(init.begin(), init.end()));
+
+	for (unsigned s = 0, n = aut->num_states(); s < n; ++s) {
+		writer.add_state();
+		for (auto& e : aut->out(s)) {
+			uint32_t edge_marks = 0;
+			for (unsigned m : e.acc.sets()) {
+				edge_marks |= uint32_t(1) << m;
+			}
+			auto dests = aut->univ_dests(e.dst);
+			writer.add_edge(e.cond, std::vector<unsigned>(dests.begin(), dests.end()), edge_marks);
+		}
+	}
+
+	writer.write(out);
+}
+
+// checks that the count + 1 offsets start at 0, do not decrease and end at total
+static bool offsets_valid(const uint32_t* offsets, uint32_t count, uint32_t total) {
+	if (offsets[0] != 0 || offsets[count] != total) {
+		return false;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		if (offsets[i] > offsets[i + 1]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// checks that the count numbers are below bound
+static bool numbers_valid(const uint32_t* numbers, uint32_t count, uint64_t bound) {
+	for (uint32_t i = 0; i < count; ++i) {
+		if (numbers[i] >= bound) {
+			return false;
+		}
+	}
+	return true;
+}
+
+binaut_view::binaut_view(const char* data, size_t available) : size(0) {
+	if (available < sizeof(binaut_header) || reinterpret_cast<uintptr_t>(data) % alignof(uint32_t) != 0) {
+		return;
+	}
+
+	auto h = reinterpret_cast<const binaut_header*>(data);
+	if (h->magic != binaut_magic || h->version != binaut_version) {
+		return;
+	}
+
+	// we check that the sections fit in the available data before any of them is used
+	uint64_t words = sizeof(binaut_header) / 4;
+	uint64_t need = words + (h->num_aps + 1ULL) + padded_words(h->ap_names_size) + (h->num_inits + 1ULL)
+		+ h->num_init_targets + (h->num_states + 1ULL) + 2 * (h->num_edges + 1ULL) + h->num_edges
+		+ h->num_targets + (h->num_cubes + 1ULL) + h->num_literals + padded_words(h->acceptance_size);
+	if (need * 4 > available) {
+		return;
+	}
+
+	auto p = reinterpret_cast<const uint32_t*>(data) + words;
+	ap_offsets = p;
+	p += h->num_aps + 1;
+	ap_names = reinterpret_cast<const char*>(p);
+	p += padded_words(h->ap_names_size);
+	init_offsets = p;
+	p += h->num_inits + 1;
+	init_targets = p;
+	p += h->num_init_targets;
+	state_offsets = p;
+	p += h->num_states + 1;
+	target_offsets = p;
+	p += h->num_edges + 1;
+	cube_offsets = p;
+	p += h->num_edges + 1;
+	marks = p;
+	p += h->num_edges;
+	targets = p;
+	p += h->num_targets;
+	literal_offsets = p;
+	p += h->num_cubes + 1;
+	literals = p;
+	p += h->num_literals;
+	acceptance = reinterpret_cast<const char*>(p);
+
+	// the record may come from anywhere, so every offset and every number of a state, an AP or a set is checked
+	// before to_twa uses them as indices
+	if (!offsets_valid(ap_offsets, h->num_aps, h->ap_names_size)
+		|| !offsets_valid(init_offsets, h->num_inits, h->num_init_targets)
+		|| !offsets_valid(state_offsets, h->num_states, h->num_edges)
+		|| !offsets_valid(target_offsets, h->num_edges, h->num_targets)
+		|| !offsets_valid(cube_offsets, h->num_edges, h->num_cubes)
+		|| !offsets_valid(literal_offsets, h->num_cubes, h->num_literals)
+		|| !numbers_valid(init_targets, h->num_init_targets, h->num_states)
+		|| !numbers_valid(targets, h->num_targets, h->num_states)
+		|| !numbers_valid(literals, h->num_literals, 2ULL * h->num_aps)
+		|| h->num_acc_sets > 32) {
+		return;
+	}
+	uint32_t allowed_marks = h->num_acc_sets == 32 ? ~uint32_t(0) : (uint32_t(1) << h->num_acc_sets) - 1;
+	for (unsigned e = 0; e < h->num_edges; ++e) {
+		if ((marks[e] & ~allowed_marks) != 0) {
+			return;
+		}
+	}
+
+	// the acceptance must parse and use only the declared sets
+	try {
+		spot::acc_cond::acc_code code(std::string(acceptance, h->acceptance_size).c_str());
+		if (code.used_sets().max_set() > h->num_acc_sets) {
+			return;
+		}
+	} catch (spot::parse_error&) {
+		return;
+	}
+
+	size = need * 4;
+	header = h;
+}
+
+spot::twa_graph_ptr binaut_view::to_twa(const spot::bdd_dict_ptr& dict) const {
+	auto aut = spot::make_twa_graph(dict);
+
+	std::vector<int> ap_vars;
+	for (unsigned ap = 0; ap < num_aps(); ++ap) {
+		ap_vars.push_back(aut->register_ap(ap_name(ap)));
+	}
+
+	std::vector<bdd> labels;
+	bool sink_needed = false;
+	for (unsigned e = 0; e < num_edges(); ++e) {
+		bdd label = bddfalse;
+		for (unsigned c = cubes_begin(e); c < cubes_end(e); ++c) {
+			bdd cube = bddtrue;
+			for (uint32_t literal : this->cube(c)) {
+				int var = ap_vars[literal >> 1];
+				cube &= (literal & 1) ? bdd_nithvar(var) : bdd_ithvar(var);
+			}
+			label |= cube;
+		}
+		labels.push_back(label);
+
+		if (edge_targets(e).size() == 0) {
+			sink_needed = true;
+		}
+	}
+	for (unsigned i = 0; i < num_inits(); ++i) {
+		if (init(i).size() == 0) {
+			sink_needed = true;
+		}
+	}
+
+	aut->new_states(num_states());
+
+	// Spot has no empty universal edges, we redirect them into a state accepting everything
+	unsigned sink = -1U;
+	if (sink_needed) {
+		sink = aut->new_state();
+		aut->new_edge(sink, sink, bddtrue);
+	}
+
+	auto add_edge = [&](unsigned src, bdd label, const std::vector<unsigned>& dests, uint32_t edge_marks) {
+		std::vector<unsigned> sets;
+		for (unsigned m = 0; m < 32; ++m) {
+			if ((edge_marks >> m) & 1) {
+				sets.push_back(m);
+			}
+		}
+		spot::acc_cond::mark_t acc(sets.begin(), sets.end());
+
+		if (dests.empty()) {
+			aut->new_edge(src, sink, label, acc);
+		} else if (dests.size() == 1) {
+			aut->new_edge(src, dests[0], label, acc);
+		} else {
+			aut->new_univ_edge(src, dests.begin(), dests.end(), label, acc);
+		}
+	};
+
+	for (unsigned s = 0; s < num_states(); ++s) {
+		for (unsigned e = edges_begin(s); e < edges_end(s); ++e) {
+			auto dests = edge_targets(e);
+			add_edge(s, labels[e], std::vector<unsigned>(dests.begin(), dests.end()), edge_marks(e));
+		}
+	}
+
+	if (num_inits() == 1 && init(0).size() > 0) {
+		auto dests = init(0);
+		if (dests.size() == 1) {
+			aut->set_init_state(*dests.begin());
+		} else {
+			aut->set_univ_init_state(dests.begin(), dests.end());
+		}
+	} else if (num_inits() > 0) {
+		// the new initial state has the edges of all initial configurations, the edges of
+		// a configuration are the products of one edge of each of its states
+		unsigned init_state = aut->new_state();
+		for (unsigned i = 0; i < num_inits(); ++i) {
+			std::vector<std::tuple<bdd, std::set<unsigned>, uint32_t>> products = { std::make_tuple(bddtrue, std::set<unsigned>(), 0) };
+			for (uint32_t q : init(i)) {
+				std::vector<std::tuple<bdd, std::set<unsigned>, uint32_t>> new_products;
+				for (auto& product : products) {
+					for (unsigned e = edges_begin(q); e < edges_end(q); ++e) {
+						bdd label = std::get<0>(product) & labels[e];
+						if (label != bddfalse) {
+							std::set<unsigned> dests = std::get<1>(product);
+							dests.insert(edge_targets(e).begin(), edge_targets(e).end());
+							new_products.push_back(std::make_tuple(label, dests, std::get<2>(product) | edge_marks(e)));
+						}
+					}
+				}
+				products.swap(new_products);
+			}
+
+			for (auto& product : products) {
+				auto& dests = std::get<1>(product);
+				add_edge(init_state, std::get<0>(product), std::vector<unsigned>(dests.begin(), dests.end()), std::get<2>(product));
+			}
+		}
+		aut->set_init_state(init_state);
+	}
+
+	aut->set_acceptance(num_acc_sets(), spot::acc_cond::acc_code(acceptance_text().c_str()));
+
+	return aut;
+}
+
+mapped_file::mapped_file(const std::string& path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			data = static_cast<const char*>(p);
+			size = st.st_size;
+		}
+	}
+
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+}
+
+mapped_file::~mapped_file() {
+	if (data != nullptr) {
+		munmap(const_cast<char*>(data), size);
+	}
+}
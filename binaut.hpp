@@ -0,0 +1,188 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BINAUT_H
+#define BINAUT_H
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <bddx.h>
+#include <spot/twa/twagraph.hh>
+
+// The binary automaton format (-o bin). A record consists of 32-bit numbers in the byte order
+// of the machine that wrote it, so that a reader can use the arrays directly from a mapped file:
+//
+//   header          magic "LSDB", version, and the counts below
+//   ap_offsets      num_aps + 1 offsets into ap_names
+//   ap_names        the names of atomic propositions, padded to 4 bytes
+//   init_offsets    num_inits + 1 offsets into init_targets, one entry per initial configuration
+//   init_targets    states of the initial configurations
+//   state_offsets   num_states + 1 offsets into the edge arrays, edges are sorted by source
+//   target_offsets  num_edges + 1 offsets into targets
+//   cube_offsets    num_edges + 1 offsets into literal_offsets, the label is a disjunction of cubes
+//   marks           num_edges acceptance marks, bit i stands for the set i
+//   targets         universal targets of the edges (an empty set means true)
+//   literal_offsets num_cubes + 1 offsets into literals
+//   literals        2 * ap + 1 for a negated ap, 2 * ap otherwise
+//   acceptance      the acceptance formula in the HOA syntax, padded to 4 bytes
+//
+// Several records (the VWAA and the SDBA for -p3) may follow each other in one file.
+
+struct binaut_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_aps;
+	uint32_t ap_names_size;
+	uint32_t num_inits;
+	uint32_t num_init_targets;
+	uint32_t num_states;
+	uint32_t num_edges;
+	uint32_t num_targets;
+	uint32_t num_cubes;
+	uint32_t num_literals;
+	uint32_t num_acc_sets;
+	uint32_t acceptance_size;
+};
+
+// collects an automaton and writes it as one record
+class binaut_writer {
+protected:
+	std::vector<std::string> aps;
+	std::vector<uint32_t> init_offsets = { 0 };
+	std::vector<uint32_t> init_targets;
+	std::vector<uint32_t> state_offsets = { 0 };
+	std::vector<uint32_t> target_offsets = { 0 };
+	std::vector<uint32_t> cube_offsets = { 0 };
+	std::vector<uint32_t> marks;
+	std::vector<uint32_t> targets;
+	std::vector<uint32_t> literal_offsets = { 0 };
+	std::vector<uint32_t> literals;
+	unsigned num_acc_sets;
+	std::string acceptance;
+
+	// BDD variable -> index in aps
+	std::vector<int> ap_of_var;
+
+public:
+	// aps are the atomic propositions with their BDD variables in dict
+	binaut_writer(const std::vector<spot::formula>& aps, const spot::bdd_dict_ptr& dict,
+		unsigned num_acc_sets, const spot::acc_cond::acc_code& acceptance);
+
+	void add_init(const std::vector<unsigned>& init_set);
+
+	// starts the edges of the next state
+	void add_state();
+
+	void add_edge(bdd label, const std::vector<unsigned>& edge_targets, uint32_t edge_marks);
+
+	void write(std::ostream& out) const;
+};
+
+// writes the Spot automaton (possibly alternating) as one record
+void print_binary(std::ostream& out, const spot::const_twa_graph_ptr& aut);
+
+// a read-only view of one record in memory, nothing is copied
+class binaut_view {
+public:
+	// a range of numbers inside the record
+	struct range {
+		const uint32_t* first;
+		const uint32_t* last;
+		const uint32_t* begin() const { return first; }
+		const uint32_t* end() const { return last; }
+		unsigned size() const { return last - first; }
+	};
+
+protected:
+	const binaut_header* header = nullptr;
+	const uint32_t* ap_offsets;
+	const char* ap_names;
+	const uint32_t* init_offsets;
+	const uint32_t* init_targets;
+	const uint32_t* state_offsets;
+	const uint32_t* target_offsets;
+	const uint32_t* cube_offsets;
+	const uint32_t* marks;
+	const uint32_t* targets;
+	const uint32_t* literal_offsets;
+	const uint32_t* literals;
+	const char* acceptance;
+	size_t size;
+
+public:
+	// checks the record at data, is_valid() tells the result
+	binaut_view(const char* data, size_t available);
+
+	bool is_valid() const { return header != nullptr; }
+
+	// the number of bytes of the record, the next one starts right after it
+	size_t record_size() const { return size; }
+
+	unsigned num_aps() const { return header->num_aps; }
+	std::string ap_name(unsigned ap) const {
+		return std::string(ap_names + ap_offsets[ap], ap_offsets[ap + 1] - ap_offsets[ap]);
+	}
+
+	unsigned num_inits() const { return header->num_inits; }
+	range init(unsigned i) const { return { init_targets + init_offsets[i], init_targets + init_offsets[i + 1] }; }
+
+	unsigned num_states() const { return header->num_states; }
+	unsigned num_edges() const { return header->num_edges; }
+
+	// the edges of a state are edges_begin(state), ..., edges_end(state) - 1
+	unsigned edges_begin(unsigned state) const { return state_offsets[state]; }
+	unsigned edges_end(unsigned state) const { return state_offsets[state + 1]; }
+
+	range edge_targets(unsigned edge) const { return { targets + target_offsets[edge], targets + target_offsets[edge + 1] }; }
+	uint32_t edge_marks(unsigned edge) const { return marks[edge]; }
+
+	// the cubes of an edge are cubes_begin(edge), ..., cubes_end(edge) - 1
+	unsigned cubes_begin(unsigned edge) const { return cube_offsets[edge]; }
+	unsigned cubes_end(unsigned edge) const { return cube_offsets[edge + 1]; }
+	range cube(unsigned c) const { return { literals + literal_offsets[c], literals + literal_offsets[c + 1] }; }
+
+	unsigned num_acc_sets() const { return header->num_acc_sets; }
+	std::string acceptance_text() const { return std::string(acceptance, header->acceptance_size); }
+
+	// builds the Spot automaton, edges with no targets lead to an added sink state and
+	// several initial configurations are joined in an added initial state
+	spot::twa_graph_ptr to_twa(const spot::bdd_dict_ptr& dict) const;
+};
+
+// a file mapped into memory
+class mapped_file {
+protected:
+	const char* data = nullptr;
+	size_t size = 0;
+
+public:
+	mapped_file(const std::string& path);
+	~mapped_file();
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	bool is_open() const { return data != nullptr; }
+	const char* get_data() const { return data; }
+	size_t get_size() const { return size; }
+};
+
+#endif
@@ -0,0 +1,217 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BITSET_H
+#define BITSET_H
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+// a set of numbers smaller than a fixed size (states of the VWAA, letters...)
+// stored as 64-bit words; the methods are defined here so that they can be inlined
+// in the loops of the semideterministic construction
+class BitSet {
+protected:
+	std::vector<uint64_t> words;
+
+public:
+	BitSet(unsigned size = 0) : words((size + 63) / 64, 0) {}
+
+	// adds a number to the set
+	void insert(unsigned i) {
+		words[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+
+	// removes a number from the set
+	void erase(unsigned i) {
+		words[i >> 6] &= ~(uint64_t(1) << (i & 63));
+	}
+
+	// checks whether the number is in the set
+	bool contains(unsigned i) const {
+		return (i >> 6) < words.size() && ((words[i >> 6] >> (i & 63)) & 1);
+	}
+
+	// removes all numbers from the set
+	void clear() {
+		std::fill(words.begin(), words.end(), 0);
+	}
+
+	bool empty() const {
+		for (auto w : words) {
+			if (w != 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// returns the number of elements
+	unsigned count() const {
+		unsigned result = 0;
+		for (auto w : words) {
+			result += __builtin_popcountll(w);
+		}
+		return result;
+	}
+
+	// returns the smallest element, or -1U if the set is empty
+	unsigned first() const {
+		return next(0);
+	}
+
+	// returns the smallest element greater or equal to i, or -1U if there is none
+	unsigned next(unsigned i) const {
+		unsigned wi = i >> 6;
+		if (wi >= words.size()) {
+			return -1U;
+		}
+
+		uint64_t w = words[wi] & (~uint64_t(0) << (i & 63));
+		while (w == 0) {
+			if (++wi == words.size()) {
+				return -1U;
+			}
+			w = words[wi];
+		}
+
+		return (wi << 6) + __builtin_ctzll(w);
+	}
+
+	// returns the elements in increasing order
+	std::vector<unsigned> elements() const {
+		std::vector<unsigned> result;
+		for (unsigned i = first(); i != -1U; i = next(i + 1)) {
+			result.push_back(i);
+		}
+		return result;
+	}
+
+	BitSet& operator|=(const BitSet& other) {
+		assert(words.size() == other.words.size());
+		for (unsigned wi = 0, size = words.size(); wi < size; ++wi) {
+			words[wi] |= other.words[wi];
+		}
+		return *this;
+	}
+
+	BitSet& operator&=(const BitSet& other) {
+		assert(words.size() == other.words.size());
+		for (unsigned wi = 0, size = words.size(); wi < size; ++wi) {
+			words[wi] &= other.words[wi];
+		}
+		return *this;
+	}
+
+	// removes all elements of other
+	BitSet& operator-=(const BitSet& other) {
+		assert(words.size() == other.words.size());
+		for (unsigned wi = 0, size = words.size(); wi < size; ++wi) {
+			words[wi] &= ~other.words[wi];
+		}
+		return *this;
+	}
+
+	BitSet operator|(const BitSet& other) const {
+		BitSet result(*this);
+		result |= other;
+		return result;
+	}
+
+	BitSet operator&(const BitSet& other) const {
+		BitSet result(*this);
+		result &= other;
+		return result;
+	}
+
+	BitSet operator-(const BitSet& other) const {
+		BitSet result(*this);
+		result -= other;
+		return result;
+	}
+
+	// checks whether each element of this set is in other
+	bool is_subset_of(const BitSet& other) const {
+		assert(words.size() == other.words.size());
+		for (unsigned wi = 0, size = words.size(); wi < size; ++wi) {
+			if ((words[wi] & ~other.words[wi]) != 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// checks whether the sets have a common element
+	bool intersects(const BitSet& other) const {
+		assert(words.size() == other.words.size());
+		for (unsigned wi = 0, size = words.size(); wi < size; ++wi) {
+			if ((words[wi] & other.words[wi]) != 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool operator==(const BitSet& other) const {
+		return words == other.words;
+	}
+
+	bool operator!=(const BitSet& other) const {
+		return words != other.words;
+	}
+
+	bool operator<(const BitSet& other) const {
+		return words < other.words;
+	}
+
+	size_t hash() const {
+		size_t h = words.size();
+		for (auto w : words) {
+			h ^= std::hash<uint64_t>()(w) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		}
+		return h;
+	}
+
+	// direct access to the words for word-parallel algorithms
+	const std::vector<uint64_t>& get_words() const {
+		return words;
+	}
+};
+
+// prints the set as {1,2,3}
+inline std::ostream& operator<<(std::ostream& out, const BitSet& s) {
+	out << '{';
+	for (unsigned i = s.first(); i != -1U; i = s.next(i + 1)) {
+		out << (i == s.first() ? "" : ",") << i;
+	}
+	return out << '}';
+}
+
+namespace std {
+	template<> struct hash<BitSet> {
+		size_t operator()(const BitSet& s) const {
+			return s.hash();
+		}
+	};
+}
+
+#endif
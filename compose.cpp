@@ -0,0 +1,340 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <spot/parseaut/public.hh>
+#include <spot/tl/apcollect.hh>
+#include <spot/tl/length.hh>
+#include <spot/twaalgos/hoa.hh>
+#include <spot/twaalgos/product.hh>
+#include <spot/twaalgos/sccinfo.hh>
+#include "compose.hpp"
+#include "semideterministic.hpp"
+#include "server.hpp"
+
+std::vector<spot::formula> split_conjunction(spot::formula f) {
+	if (!f.is(spot::op::And)) {
+		return { f };
+	}
+
+	// group[i] is the group of the operand i, groups sharing an atomic proposition are joined
+	unsigned size = f.size();
+	std::vector<unsigned> group(size);
+	std::map<spot::formula, unsigned> group_of_ap;
+	for (unsigned i = 0; i < size; ++i) {
+		group[i] = i;
+		std::unique_ptr<spot::atomic_prop_set> aps(spot::atomic_prop_collect(f[i]));
+		for (auto& ap : *aps) {
+			auto it = group_of_ap.find(ap);
+			if (it == group_of_ap.end()) {
+				group_of_ap[ap] = group[i];
+			} else if (it->second != group[i]) {
+				unsigned old_group = group[i];
+				for (auto& g : group) {
+					if (g == old_group) {
+						g = it->second;
+					}
+				}
+				for (auto& ga : group_of_ap) {
+					if (ga.second == old_group) {
+						ga.second = it->second;
+					}
+				}
+			}
+		}
+	}
+
+	std::map<unsigned, std::vector<spot::formula>> operands;
+	for (unsigned i = 0; i < size; ++i) {
+		operands[group[i]].push_back(f[i]);
+	}
+
+	std::vector<spot::formula> result;
+	for (auto& o : operands) {
+		result.push_back(spot::formula::And(o.second));
+	}
+	return result;
+}
+
+std::vector<spot::formula> split_disjunction(spot::formula f) {
+	if (!f.is(spot::op::Or)) {
+		return { f };
+	}
+
+	// the operands are taken in their order, a group is closed once it is long enough
+	std::vector<std::vector<spot::formula>> groups(1);
+	unsigned length = 0;
+	for (auto g : f) {
+		groups.back().push_back(g);
+		length += spot::length(g);
+		if (length >= min_disjunct_length) {
+			groups.emplace_back();
+			length = 0;
+		}
+	}
+
+	// the rest too short for a group of its own goes to the last group
+	if (groups.back().empty()) {
+		groups.pop_back();
+	} else if (groups.size() > 1) {
+		auto rest = groups.back();
+		groups.pop_back();
+		groups.back().insert(groups.back().end(), rest.begin(), rest.end());
+	}
+
+	std::vector<spot::formula> result;
+	for (auto& group : groups) {
+		result.push_back(spot::formula::Or(group));
+	}
+	return result;
+}
+
+// the processor time of the finished children in seconds
+static double children_time() {
+	struct rusage usage;
+	getrusage(RUSAGE_CHILDREN, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// renumbers the states of the combined SDBA so that the deterministic states (see deterministic_states) come last,
+// as in the SDBA of make_semideterministic, and sets its properties like make_semideterministic does
+static void set_properties(spot::twa_graph_ptr& sdba) {
+	auto deterministic = deterministic_states(sdba);
+
+	std::vector<unsigned> new_number(sdba->num_states());
+	unsigned det_part = 0;
+	for (unsigned s = 0; s < sdba->num_states(); ++s) {
+		if (!deterministic[s]) {
+			new_number[s] = det_part++;
+		}
+	}
+	unsigned next = det_part;
+	for (unsigned s = 0; s < sdba->num_states(); ++s) {
+		if (deterministic[s]) {
+			new_number[s] = next++;
+		}
+	}
+	sdba->defrag_states(new_number, next);
+
+	setProperties(sdba, det_part);
+}
+
+// a worker translating one part
+struct worker {
+	pid_t pid;
+	int fd;
+};
+
+// starts a worker for the part f, the worker has pid -1 if it could not be started
+static worker start_worker(spot::formula f, sdba_function translate) {
+	int fds[2];
+	if (pipe(fds) != 0) {
+		return { -1, -1 };
+	}
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		// we leave by _exit, so that the buffers of the parent are not flushed twice
+		close(fds[0]);
+		int status = 1;
+		try {
+			auto sdba = translate(f);
+			std::ostringstream hoa;
+			spot::print_hoa(hoa, sdba);
+			write_response(fds[1], hoa.str());
+			status = 0;
+		} catch (...) {
+		}
+		close(fds[1]);
+		_exit(status);
+	}
+
+	close(fds[1]);
+	if (pid < 0) {
+		close(fds[0]);
+	}
+	return { pid, fds[0] };
+}
+
+// reads the SDBA of the worker and waits for it, returns nullptr if it failed
+static spot::twa_graph_ptr finish_worker(worker w, const spot::bdd_dict_ptr& dict) {
+	if (w.pid < 0) {
+		return nullptr;
+	}
+
+	std::string hoa;
+	char buffer[4096];
+	while (true) {
+		ssize_t count = read(w.fd, buffer, sizeof(buffer));
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			break;
+		}
+		hoa.append(buffer, count);
+	}
+	close(w.fd);
+
+	int status;
+	while (waitpid(w.pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return nullptr;
+	}
+
+	spot::automaton_stream_parser parser(hoa.c_str(), "worker");
+	auto parsed = parser.parse(dict);
+	if (parsed == nullptr || parsed->aborted || parsed->format_errors(std::cerr)) {
+		return nullptr;
+	}
+	return parsed->aut;
+}
+
+spot::twa_graph_ptr translate_parts(const std::vector<spot::formula>& parts, sdba_function translate,
+	combine_function combine, compose_stats* stats) {
+	auto start = std::chrono::steady_clock::now();
+	double start_time = children_time();
+
+	auto dict = spot::make_bdd_dict();
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned max_workers = processors > 0 ? processors : 1;
+
+	// the workers are started in the order of the parts, the results are collected in the same order
+	std::vector<worker> workers;
+	unsigned started = 0;
+	spot::twa_graph_ptr result = nullptr;
+	bool failed = false;
+	for (unsigned i = 0; i < parts.size(); ++i) {
+		while (started < parts.size() && started < i + max_workers) {
+			workers.push_back(start_worker(parts[started], translate));
+			++started;
+		}
+
+		auto sdba = finish_worker(workers[i], dict);
+		if (sdba == nullptr) {
+			// the other workers are still collected
+			failed = true;
+		} else if (!failed) {
+			result = result == nullptr ? sdba : combine(result, sdba);
+			failed = result == nullptr;
+		}
+	}
+
+	if (!failed) {
+		set_properties(result);
+	}
+
+	if (stats != nullptr) {
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		stats->elapsed = elapsed.count();
+		stats->parallelism = elapsed.count() > 0 ? (children_time() - start_time) / elapsed.count() : 1;
+	}
+	return failed ? nullptr : result;
+}
+
+std::vector<bool> deterministic_states(const spot::const_twa_graph_ptr& aut) {
+	spot::scc_info si(aut);
+
+	// Spot numbers the SCCs in reverse topological order, so the successors of an SCC are decided before it
+	std::vector<bool> scc_deterministic(si.scc_count(), true);
+	for (unsigned scc = 0; scc < si.scc_count(); ++scc) {
+		for (auto s : si.states_of(scc)) {
+			bdd seen = bddfalse;
+			for (auto& t : aut->out(s)) {
+				if ((seen & t.cond) != bddfalse || !scc_deterministic[si.scc_of(t.dst)]) {
+					scc_deterministic[scc] = false;
+				}
+				seen |= t.cond;
+			}
+		}
+	}
+
+	std::vector<bool> result(aut->num_states(), false);
+	for (unsigned s = 0; s < aut->num_states(); ++s) {
+		unsigned scc = si.scc_of(s);
+		result[s] = scc != -1U && scc_deterministic[scc];
+	}
+	return result;
+}
+
+spot::twa_graph_ptr sdba_product(const spot::const_twa_graph_ptr& a, const spot::const_twa_graph_ptr& b) {
+	auto result = spot::product(a, b);
+
+	// a state of the product is deterministic (with all its successors) iff both its states are, which is
+	// where an accepting run ends up; the marks seen before are finitely many, so they can be dropped
+	auto deterministic = deterministic_states(result);
+	for (auto& t : result->edges()) {
+		if (!deterministic[t.src]) {
+			t.acc = {};
+		}
+	}
+
+	result->prop_semi_deterministic(true);
+	return result;
+}
+
+spot::twa_graph_ptr sdba_union(const spot::const_twa_graph_ptr& a, const spot::const_twa_graph_ptr& b) {
+	if (!a->acc().is_generalized_buchi() || !b->acc().is_generalized_buchi()) {
+		return nullptr;
+	}
+
+	auto result = spot::make_twa_graph(a->get_dict());
+	result->copy_ap_of(a);
+	result->copy_ap_of(b);
+	unsigned sets = std::max(a->num_sets(), b->num_sets());
+	result->set_generalized_buchi(sets);
+
+	// the state 0 is the new initial state, then come the states of a and the states of b
+	result->new_states(1 + a->num_states() + b->num_states());
+	result->set_init_state(0);
+
+	auto copy = [&](const spot::const_twa_graph_ptr& aut, unsigned offset) {
+		// the last set of aut stands for the sets it does not have
+		spot::acc_cond::mark_t missing = {};
+		for (unsigned i = aut->num_sets(); i < sets; ++i) {
+			missing.set(i);
+		}
+		auto marks = [&](spot::acc_cond::mark_t acc) {
+			return aut->num_sets() > 0 && acc.has(aut->num_sets() - 1) ? acc | missing : acc;
+		};
+
+		for (auto& t : aut->edges()) {
+			result->new_edge(offset + t.src, offset + t.dst, t.cond, marks(t.acc));
+			if (t.src == aut->get_init_state_number()) {
+				result->new_edge(0, offset + t.dst, t.cond, marks(t.acc));
+			}
+		}
+	};
+	copy(a, 1);
+	copy(b, 1 + a->num_states());
+
+	// the new initial state is the only added nondeterminism and it is left at once
+	result->merge_edges();
+	result->prop_semi_deterministic(true);
+	return result;
+}
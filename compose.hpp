@@ -0,0 +1,69 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPOSE_H
+#define COMPOSE_H
+#include <vector>
+#include <spot/tl/parse.hh>
+#include <spot/twa/twagraph.hh>
+
+// translates a formula into an SDBA
+typedef spot::twa_graph_ptr (*sdba_function)(spot::formula f);
+
+// combines two SDBAs with the same bdd_dict into one, returns nullptr if it cannot
+typedef spot::twa_graph_ptr (*combine_function)(const spot::const_twa_graph_ptr& a, const spot::const_twa_graph_ptr& b);
+
+// disjuncts shorter than this (see spot::length) are not worth a worker of their own
+const unsigned min_disjunct_length = 10;
+
+// splits the conjunction f into conjunctions of groups of its operands, two operands are in the same group
+// if they share an atomic proposition (also through other operands); returns { f } for other formulae
+std::vector<spot::formula> split_conjunction(spot::formula f);
+
+// splits the disjunction f into disjunctions of groups of its operands, the operands shorter than
+// min_disjunct_length are joined with their neighbours until the group is long enough; returns { f }
+// for other formulae and for disjunctions too short to give two groups
+std::vector<spot::formula> split_disjunction(spot::formula f);
+
+// the times of translate_parts
+struct compose_stats {
+	double elapsed;		// seconds from the start of the first worker to the combined SDBA
+	double parallelism;	// processor time of the workers divided by elapsed
+};
+
+// translates each part by translate in a separate worker process (at most one per processor at a time),
+// the workers send the SDBAs in HOA through pipes; returns the SDBAs joined by combine in the order
+// of the parts, or nullptr if some worker or combine failed; if stats is given, the times are stored there
+spot::twa_graph_ptr translate_parts(const std::vector<spot::formula>& parts, sdba_function translate,
+	combine_function combine, compose_stats* stats = nullptr);
+
+// returns the product of the semideterministic automata a and b (with the same bdd_dict), the marks are only kept
+// on the edges of states from which only deterministic states are reachable, so the product is semideterministic;
+// an accepting run reaches such states in both automata, so the language is the intersection
+spot::twa_graph_ptr sdba_product(const spot::const_twa_graph_ptr& a, const spot::const_twa_graph_ptr& b);
+
+// returns the union of the semideterministic automata a and b (with the same bdd_dict and generalized Büchi
+// acceptance): the states of a and b and a new initial state with the edges of both initial states;
+// the automaton with fewer sets repeats its last set in the missing ones; nullptr for other acceptance
+spot::twa_graph_ptr sdba_union(const spot::const_twa_graph_ptr& a, const spot::const_twa_graph_ptr& b);
+
+// returns for each state of aut whether all states reachable from it (itself included) are deterministic
+std::vector<bool> deterministic_states(const spot::const_twa_graph_ptr& aut);
+
+#endif
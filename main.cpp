@@ -18,6 +18,7 @@
     along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <spot/misc/version.hh>
@@ -35,22 +36,58 @@
 #include "alternating.hpp"
 #include "semideterministic.hpp"
 #include "automaton.hpp"
+#include "binaut.hpp"
+#include "compose.hpp"
+#include "server.hpp"
+#include "trace.hpp"
 
 bool o_single_init_state;	// -i
 bool o_vwaa_determ;			// -d
 unsigned o_eq_level;		// -e
-unsigned o_debug_mode;		// -g
+bool o_merge_vwaa;			// -M
 bool o_mergeable_info;		// -m
 bool o_ac_filter_fin;		// -t
 bool o_spot_simulation;		// -u
 bool o_spot_scc_filter;		// -z
+bool o_stats;				// -y
+bool o_gen_buchi;			// -g
+bool o_antichains;			// -A
+bool o_reorder;				// -r
+bool o_compose;				// -C
+bool o_decompose;			// -D
+bool o_weak_fragments;		// -w
+unsigned o_u_merge_level;	// -F
+unsigned o_g_merge_level;	// -G
 
 bool o_x_single_succ;		// -X
+spot::formula o_assume;		// --assume
+bool o_no_names;			// --no-names
+
+// translates the formula args["f"] with the options in args and prints the automaton to std::cout,
+// returns the exit code of the translation
+int translate(std::map<std::string, std::string>& args);
+
+// removes the unreachable states and unnecessary marks of vwaa and merges its equivalent states (with -e)
+void simplify_vwaa(VWAA* vwaa);
+
+// translates f into an SDBA, this is -p2 both in the process and in the workers of -C and -D
+spot::twa_graph_ptr sdba_of(spot::formula f);
+
+// prints the times of -C or -D (mode) to stderr; if the workers succeeded, f is translated once more
+// in this process, the speedup is the time of this translation divided by the time of the workers
+void print_compose_stats(const std::string& mode, unsigned parts, bool succeeded, const compose_stats& stats,
+	spot::formula f);
+
+// prints all automata of the binary file path in the given format, returns the exit code
+int print_binary_file(const std::string& path, const std::string& format);
 
 int main(int argc, char* argv[])
 {
 	std::string version("1.1.1");
 
+	// std::cout is only used through iostreams, so it can keep its own buffer
+	std::ios::sync_with_stdio(false);
+
 	bdd_init(1000, 1000);
 	// hide "garbage collection" messages from BuDDy
 	bdd_gbc_hook(nullptr);
@@ -62,43 +99,86 @@ int main(int argc, char* argv[])
 		return 0;
 	}
 
+	if (args.count("L") > 0) {
+		return print_binary_file(args["L"], args["o"]);
+	}
+
+	if (args.count("S") > 0) {
+		unsigned max_requests = args.count("R") > 0 ? std::stoul(args["R"]) : 1000;
+		return run_server(args["S"], max_requests, argv, translate);
+	}
+
 	bool invalid_run = args.count("f") == 0;
 
 	if (invalid_run || args.count("h") > 0) {
 		std::cout << "LTL2SDBA " << version << " (using Spot " << spot::version() << ")\n\n"
 			<< "usage: " << argv[0] << " [-flags] -f formula\n"
 			<< "available flags:\n"
+			<< "\t--assume f\tonly letters satisfying the Boolean formula f can occur (default true)\n"
 			<< "\t-a[0|2|3]\tact like\n"
 			<< "\t\t0\tdo not simulate anything (default)\n"
 			<< "\t\t2\tltl2ba (like -d0 -u0 -n0 -e1)\n"
-			<< "\t\t3\tltl3ba (like -u0 -n0 -i1 -X1)\n"
-            << "\t-b[0|1]\tprint debug messages (default off)\n"
+			<< "\t\t3\tltl3ba (like -u0 -n0 -i1 -X1 -F1)\n"
+			<< "\t-A[0|1]\tphis of the deterministic part as antichains of configurations instead of BDDs (default off)\n"
+			<< "\t-b[0|1|2|3]\ttrace level of the SDBA construction (default off), needs make TRACE=1\n"
+			<< "\t-C[0|1]\ttranslate groups of conjuncts with disjoint atomic propositions in parallel and\n"
+			<< "\t\tcombine them by a product, only for -p2 (default off); conjuncts sharing an atomic\n"
+			<< "\t\tproposition (also through other conjuncts) stay in one group, so a specification\n"
+			<< "\t\twhose conjuncts are all coupled is not split at all\n"
+			<< "\t-D[0|1]\ttranslate groups of disjuncts (each of length at least 10) in parallel and\n"
+			<< "\t\tjoin them by a union, only for -p2 (default off)\n"
+			<< "\t-c cats\ttraced categories, comma-separated: vwaa, conf, rcomp, succ, mt (default all)\n"
 			<< "\t-d[0|1]\tmore deterministic VWAA construction (default on)\n"
 			<< "\t-e[0|1|2]\tequivalence check on NA\n"
 			<< "\t\t0\tno check\n"
 			<< "\t\t1\tltl2ba's simple check\n"
 			<< "\t\t2\tltl3ba's improved check (default)\n"
+			<< "\t-F[0|1]\tmerging of alpha-mergeable U-formulae in the VWAA, like ltl3ba (default off)\n"
+			<< "\t-g[0|1]\tgeneralized Buchi acceptance with one mark per independent obligation group of R (default off)\n"
+			<< "\t-G[0|1|2]\tmerging of G and F subformulae in the VWAA (default off)\n"
+			<< "\t\t1\tsuspendable subformulae (like GFa or FGa) are moved out of X, U and R\n"
+			<< "\t\t2\talso F(a U b) = Fb, G(a R b) = Gb and nested F and G are moved out of F and G\n"
 			<< "\t-h, -?\tprint this help\n"
 			<< "\t-i[0|1]\tproduce VWAA with one initial state (default off for printing phase 1, otherwise fixed as on)\n"
+			<< "\t-L file\tload automata written with -o bin and print them with -o hoa or dot\n"
 			<< "\t-m[0|1]\tcheck formula for containment of some alpha-mergeable U (default off)\n"
+			<< "\t-M[0|1]\tmerging of equivalent VWAA states by partition refinement (default on)\n"
+			<< "\t--no-names\tdo not print the names of states\n"
 			<< "\t-n[0|1]\ttry translating !f and complementing the automaton (default on) -currently disabled function\n"
-			<< "\t-o [hoa|dot]\ttype of output\n"
+			<< "\t-o [hoa|dot|bin]\ttype of output\n"
 			<< "\t\thoa\tprint automaton in HOA format (default)\n"
 			<< "\t\tdot\tprint dot format\n"
+			<< "\t\tbin\tprint compact binary format (see binaut.hpp)\n"
 			<< "\t-p[1|2|3]\tphase of translation (default 2)\n"
 			<< "\t\t1\tprint VWAA\n"
 			<< "\t\t2\tprint SDBA\n"
 			<< "\t\t3\tprint both\n"
+			<< "\t-r[0|1]\tdynamic reordering of the BDD variables of VWAA states in the deterministic part (default off)\n"
+			<< "\t-R n\tserver recycles itself after n requests (default 1000)\n"
 			<< "\t-s[0|1]\tspot's formula simplifications (default on)\n"
+			<< "\t-S path\trun as a server on the Unix socket path, see README.md\n"
+			<< "\t-T sink\twhere traces go: stderr (default), log:FILE or json:FILE (Chrome trace)\n"
 			<< "\t-t[0|1]\timproved construction of acceptance condition (default on)\n"
 			<< "\t-u[0|1]\tsimulation of nondeterministic automaton (default on)\n"
 			<< "\t-v\tprint version and exit\n"
+			<< "\t-w[0|1]\tweak deterministic automaton for safety and guarantee VWAAs, without R-components (default off)\n"
 			<< "\t-X[0|1]\ttranslate X phi as (X phi) --tt--> (phi) (default off)\n"
+			<< "\t-y[0|1]\tprint statistics of the SDBA construction to stderr (default off); with -C and -D\n"
+			<< "\t\talso the parallelism of the workers (their processor time by the elapsed time) and\n"
+			<< "\t\tthe speedup over translating the whole formula, which is then done once more\n"
 			<< "\t-z[0|1]\tcall scc_filter on nondeterministic automaton (default on)\n";
 
 		return invalid_run;
 	}
 
+	return translate(args);
+}
+
+int translate(std::map<std::string, std::string>& args)
+{
+	// the simplifier keeps its caches between the requests of a server
+	static spot::tl_simplifier tl_simplif;
+
 	spot::formula f;
 	try {
 		f = spot::parse_formula(args["f"]);
@@ -107,16 +187,50 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
-    o_debug_mode = std::stoi(args["b"]);
+	unsigned trace_level = std::stoi(args["b"]);
+#ifndef LTL2SDBA_TRACE
+	if (trace_level > 0) {
+		std::cerr << "Tracing is not compiled in, rebuild with make TRACE=1.\n";
+	}
+#endif
+	if (!trace::configure(trace_level, args["c"], args["T"])) {
+		return 1;
+	}
+
 	o_vwaa_determ = std::stoi(args["d"]);
 	o_eq_level = std::stoi(args["e"]);
+	o_merge_vwaa = std::stoi(args["M"]);
 	o_mergeable_info = std::stoi(args["m"]);
 	o_ac_filter_fin = std::stoi(args["t"]);
 	o_spot_simulation = std::stoi(args["u"]);
 	o_spot_scc_filter = std::stoi(args["z"]);
+	o_stats = std::stoi(args["y"]);
+	o_gen_buchi = std::stoi(args["g"]);
+	o_antichains = std::stoi(args["A"]);
+	o_reorder = std::stoi(args["r"]);
+	o_compose = std::stoi(args["C"]);
+	o_decompose = std::stoi(args["D"]);
+	o_weak_fragments = std::stoi(args["w"]);
+	o_u_merge_level = std::stoi(args["F"]);
+	o_g_merge_level = std::stoi(args["G"]);
 
 
 	o_x_single_succ = std::stoi(args["X"]);
+	o_no_names = std::stoi(args["no-names"]);
+
+	o_assume = spot::formula::tt();
+	if (args.count("assume") > 0) {
+		try {
+			o_assume = spot::parse_formula(args["assume"]);
+		} catch (spot::parse_error& e) {
+			std::cerr << "The assumption is invalid.\n" << e.what();
+			return 1;
+		}
+		if (!o_assume.is_boolean()) {
+			std::cerr << "The assumption has to be a Boolean formula.\n";
+			return 1;
+		}
+	}
 
 	unsigned int print_phase = std::stoi(args["p"]);
 	unsigned int try_negation = std::stoi(args["n"]);
@@ -133,46 +247,76 @@ int main(int argc, char* argv[])
 			f = spot::negative_normal_form(spot::unabbreviate(f));
 
 			if (args["s"] == "1") {
-				spot::tl_simplifier tl_simplif;
 				f = tl_simplif.simplify(f);
 			}
 
 			f = spot::unabbreviate(f);
 
-			auto vwaa = make_alternating(f);
-
-			if (o_mergeable_info) {
-				// If some mergeable is present, true is already output
-				// from the call of is_mergeable
-				std::cout << false << std::endl;
-				std::exit(0);
+			// with -C, the groups of conjuncts with disjoint atomic propositions are translated by separate workers
+			if (o_compose && print_phase == 2 && !o_mergeable_info) {
+				auto parts = split_conjunction(f);
+				if (parts.size() > 1) {
+					compose_stats stats;
+					sdba = translate_parts(parts, sdba_of, sdba_product, &stats);
+					if (o_stats) {
+						print_compose_stats("composition", parts.size(), sdba != nullptr, stats, f);
+					}
+				}
 			}
 
-			if (o_spot_scc_filter || print_phase == 2) {
-				vwaa->remove_unreachable_states();
-				vwaa->remove_unnecessary_marks();
+			// with -D, the disjuncts long enough are translated by separate workers and joined by a union
+			if (sdba == nullptr && o_decompose && print_phase == 2 && !o_mergeable_info) {
+				auto parts = split_disjunction(f);
+				if (parts.size() > 1) {
+					compose_stats stats;
+					sdba = translate_parts(parts, sdba_of, sdba_union, &stats);
+					if (o_stats) {
+						print_compose_stats("decomposition", parts.size(), sdba != nullptr, stats, f);
+					}
+				}
 			}
 
-			if (print_phase & 1) { // If print_phase is 1 or 3
-				if (args["o"] == "dot") {
-					vwaa->print_dot();
-				} else {
-					vwaa->print_hoaf();
+			// otherwise (or if a worker failed), the whole formula is translated here,
+			// for -p2 by the same function as in the workers
+			if (sdba == nullptr && print_phase == 2 && !o_mergeable_info) {
+				sdba = sdba_of(f);
+			} else if (sdba == nullptr) {
+				auto vwaa = make_alternating(f);
+
+				if (o_mergeable_info) {
+					// If some mergeable is present, true is already output
+					// from the call of is_mergeable
+					std::cout << false << std::endl;
+					delete vwaa;
+					return 0;
 				}
-			}
 
-			if (print_phase & 2) { // If print_phase is 2 or 3
+				if (o_spot_scc_filter) {
+					simplify_vwaa(vwaa);
+				}
 
-				if (!o_spot_scc_filter && print_phase != 2) {
-					vwaa->remove_unreachable_states();
-					vwaa->remove_unnecessary_marks();
+				if (print_phase & 1) { // If print_phase is 1 or 3
+					if (args["o"] == "dot") {
+						vwaa->print_dot(!o_no_names);
+					} else if (args["o"] == "bin") {
+						vwaa->print_binary();
+					} else {
+						vwaa->print_hoaf(!o_no_names);
+					}
 				}
 
-				auto sdba_temp = make_semideterministic(vwaa, o_debug_mode);
-				sdba = sdba_temp;
+				if (print_phase & 2) { // If print_phase is 2 or 3
+
+					if (!o_spot_scc_filter) {
+						simplify_vwaa(vwaa);
+					}
+
+					auto sdba_temp = make_semideterministic(vwaa);
+					sdba = sdba_temp;
 
+				}
+				delete vwaa;
 			}
-            delete vwaa;
 
 	} catch (std::runtime_error& e) {
 		std::string what(e.what());
@@ -182,6 +326,10 @@ int main(int argc, char* argv[])
 			std::cerr << "LTL2SDBA is unable to set more than 32 acceptance marks.\n";
 			return 32;
 		}
+
+		// there is no automaton to print, the server has to go on with the next request
+		std::cerr << "The translation failed: " << what << '\n';
+		return 1;
 	}
 
 	// Removing alternation and printing SDBA
@@ -189,6 +337,8 @@ int main(int argc, char* argv[])
 
 		if (args["o"] == "dot") {
 			spot::print_dot(std::cout, sdba);
+		} else if (args["o"] == "bin") {
+			print_binary(std::cout, sdba);
 		} else {
 		    spot::print_hoa(std::cout, sdba);
 			std::cout << '\n';
@@ -198,3 +348,74 @@ int main(int argc, char* argv[])
 	// We do not call bdd_done(), as we use libbddx
 	return 0;
 }
+
+void print_compose_stats(const std::string& mode, unsigned parts, bool succeeded, const compose_stats& stats,
+	spot::formula f)
+{
+	std::cerr << mode << ": " << parts << " parts in " << stats.elapsed << " s, parallelism " << stats.parallelism;
+	if (!succeeded) {
+		std::cerr << ", a worker failed, translating the whole formula\n";
+		return;
+	}
+
+	// the statistics of the baseline translation itself are not printed
+	o_stats = false;
+	auto start = std::chrono::steady_clock::now();
+	sdba_of(f);
+	std::chrono::duration<double> baseline = std::chrono::steady_clock::now() - start;
+	o_stats = true;
+
+	std::cerr << ", the whole formula in " << baseline.count() << " s, speedup "
+		<< (stats.elapsed > 0 ? baseline.count() / stats.elapsed : 1) << '\n';
+}
+
+void simplify_vwaa(VWAA* vwaa)
+{
+	vwaa->remove_unreachable_states();
+	vwaa->remove_unnecessary_marks();
+
+	if (o_merge_vwaa) {
+		vwaa->merge_equivalent_states();
+	}
+}
+
+spot::twa_graph_ptr sdba_of(spot::formula f)
+{
+	auto vwaa = make_alternating(f);
+	simplify_vwaa(vwaa);
+
+	auto sdba = make_semideterministic(vwaa);
+	delete vwaa;
+	return sdba;
+}
+
+int print_binary_file(const std::string& path, const std::string& format)
+{
+	mapped_file file(path);
+	if (!file.is_open()) {
+		std::cerr << "Unable to read " << path << ".\n";
+		return 1;
+	}
+
+	auto dict = spot::make_bdd_dict();
+	size_t offset = 0;
+	while (offset < file.get_size()) {
+		binaut_view view(file.get_data() + offset, file.get_size() - offset);
+		if (!view.is_valid()) {
+			std::cerr << path << " is not a valid binary automaton.\n";
+			return 1;
+		}
+
+		auto aut = view.to_twa(dict);
+		if (format == "dot") {
+			spot::print_dot(std::cout, aut);
+		} else {
+			spot::print_hoa(std::cout, aut);
+			std::cout << '\n';
+		}
+
+		offset += view.record_size();
+	}
+
+	return 0;
+}
@@ -18,17 +18,46 @@
 */
 
 #include <cstring>
+#include <unordered_map>
 #include "semideterministic.hpp"
 
 // These are all prefixed by "g" meaning "global" for clarity in code
 std::vector<bdd> gAlphabet; // All the combinations of atomic propositions
+BitSet gAllowed; // The letters of gAlphabet satisfying the assumption (--assume), the others never occur
 unsigned gnc; // Number of states of non-deterministic part of SDBA
 unsigned gnvwaa; // Number of states of the original VWAA
 unsigned gtnum; // Number of the state t
+const unsigned gMaxTableAps = 16; // Above this number of atomic propositions, guards are only checked as BDDs
+std::vector<int> gApVar; // BDD variable of each atomic proposition
+std::vector<int> gStateVar; // BDD variable of each state of the VWAA, see orderStateVars
+std::vector<unsigned> gClassLetter; // A letter of each class of letters enabling the same edges of the VWAA
+std::vector<bdd> gClassLabel; // The disjunction of the letters of each class
+std::unordered_map<BitSet, unsigned> gRIds; // Numbers of the Rs seen in the deterministic part, for gSuccCache
+std::unordered_map<SuccKey, SuccValue, SuccKeyHash> gSuccCache; // Successor phis, see succPhi
+unsigned long gSuccLookups; // Statistics of gSuccCache
+unsigned long gSuccHits;
+std::vector<BitSet> gClosure; // States reachable from each state of the VWAA, see computeReachClosures
+std::unordered_map<BitSet, std::vector<BitSet>> gRGroups; // Obligation groups of the Rs, see obligationGroups
+std::unordered_map<DetState, unsigned, DetStateHash> gDetIndex; // Numbers of the states of the deterministic part
 unsigned gLabel;
 bool gImplies;
-// This is the only exception to remind that the value comes from function arguments directly
-unsigned debug;
+
+#ifdef LTL2SDBA_TRACE
+static std::ostream &operator<<(std::ostream &out, const Phi &phi) {
+    if (o_antichains) {
+        return out << phi.sets;
+    }
+    return out << phi.b;
+}
+
+// Prints the phis of all obligation groups of a state
+static std::ostream &operator<<(std::ostream &out, const std::vector<Phi> &phis) {
+    for (unsigned g = 0; g < phis.size(); ++g) {
+        out << (g == 0 ? "" : " | ") << phis[g];
+    }
+    return out;
+}
+#endif
 
 // Handler, checks whether gLabel implies one of the varset expressions, returns in gImplies
 void allSatImpliesHandler(char* varset, int size) {
@@ -49,27 +78,39 @@ void allSatImpliesHandler(char* varset, int size) {
 }
 
 // Converts a given VWAA to SDBA, the main function of this class
-spot::twa_graph_ptr make_semideterministic(VWAA *vwaa, unsigned debuginput) {
-    
-    debug = debuginput;
+spot::twa_graph_ptr make_semideterministic(VWAA *vwaa) {
+
+    TRACE_SCOPE(VWAA, "make_semideterministic");
+    gtnum = -1U; // There might be no state t
+    gAlphabet.clear();
+    gClassLetter.clear();
+    gClassLabel.clear();
+    gRIds.clear();
+    gSuccCache.clear();
+    gRGroups.clear();
+    gDetIndex.clear();
+    gSuccLookups = 0;
+    gSuccHits = 0;
 
     // We first transform the VWAA into spot format
 
-    // Creating helper files and saving current stream buffer
-    std::ofstream outs;
+    // Saving current stream buffer, the helper is kept in memory, so that several translations
+    // (the workers of -C) can run in the same directory
+    std::ostringstream outs;
     std::streambuf *coutbuf = std::cout.rdbuf();
 
-    // Redirecting output into helper file and printing vwaa in hoa
-    outs.open ("helper.hoa", std::ofstream::trunc);
+    // Redirecting output into helper and printing vwaa in hoa
+    // The names of states are only needed by the trace, the state t is named in any case
     std::cout.rdbuf(outs.rdbuf());
-    vwaa->print_hoaf();
+    vwaa->print_hoaf(trace::enabled(trace::VWAA, 2));
     std::cout.rdbuf(coutbuf);
-    outs.close();
+    std::string helper = outs.str();
 
     // Parsing the helper, acquiring spot format
-    spot::parsed_aut_ptr pvwaaptr = parse_aut("helper.hoa", spot::make_bdd_dict());
+    spot::automaton_stream_parser helperParser(helper.c_str(), "helper.hoa");
+    spot::parsed_aut_ptr pvwaaptr = helperParser.parse(spot::make_bdd_dict());
     if (pvwaaptr->format_errors(std::cerr)) {
-        std::cout << "\nProblems with parsing VWAA";
+        std::cerr << "Problems with parsing VWAA\n";
         return vwaa->spot_aut;  // This should never happen since we are parsing our own VWAA
     }
     if (pvwaaptr->aborted)
@@ -79,7 +120,7 @@ spot::twa_graph_ptr make_semideterministic(VWAA *vwaa, unsigned debuginput) {
     }
     auto pvwaa = pvwaaptr->aut;
 
-    // We have VWAA parsed. Now, we assign Qmays and Qmusts and remove acceptance marks
+    // We have VWAA parsed. Now, we find the state t, flatten the VWAA and assign Qmays and Qmusts
 
     gnvwaa = pvwaa->num_states();
 
@@ -90,828 +131,1207 @@ spot::twa_graph_ptr make_semideterministic(VWAA *vwaa, unsigned debuginput) {
 
     auto snvwaa = pvwaa->get_named_prop<std::vector<std::string>>("state-names");
 
-    // We iterate over all states of the VWAA
-    for (unsigned q = 0; q < gnvwaa; ++q)
+    // We iterate over all states of the VWAA, only the named ones may be t
+    for (unsigned q = 0; snvwaa != nullptr && q < snvwaa->size(); ++q)
     {
-        if (debug == 1){std::cout << "State: " << (*snvwaa)[q] << " (" << q << ").\n";}
+        TRACE(VWAA, 2, "State " << q << ": " << (*snvwaa)[q]);
         if ((*snvwaa)[q].compare("t") == 0){
             gtnum = q;
-            if (debug == 1){std::cout << "This is the {} state.\n";}
         }
         // Renaming state to its number instead of the LTL formula for later use
         (*snvwaa)[q] = std::to_string(q);
-
-
-        isqmay[q] = false;
-        bool thereIsALoop = false;
-        // If there exists a looping, but not accepting outgoing edge, we set this state as Qmay
-        for (auto& t: pvwaa->out(q))
-        {
-            for (unsigned d: pvwaa->univ_dests(t.dst))
-            {
-                if (t.src == d && t.acc.id == 0) {
-                    isqmay[q] = true;
-                    if (debug == 1){std::cout << "Qmay. ";} // It also may be Qmust
-                    thereIsALoop = true;
-                    break;
-                }
-            }
-            if (thereIsALoop){ break; }
-        }
-        if (!isqmay[q]){
-            if (debug == 1){std::cout << "Not Qmay. ";}
-        }
-
-        isqmust[q] = true;
-        // If we find an outgoing edge, where there is no loop, we set this state as not Qmust and break the loop
-        for (auto& t: pvwaa->out(q))
-        {
-            thereIsALoop = false;
-            for (unsigned d: pvwaa->univ_dests(t.dst))
-            {
-                if (t.src == d){
-                    thereIsALoop = true;
-                }
-            }
-            if (!thereIsALoop){
-                isqmust[q] = false;
-                if (debug == 1){std::cout << "Not Qmust. ";}
-                break;
-            }
-        }
-        if (isqmust[q]) {
-            if (debug == 1){std::cout << "Qmust. ";}
-        }
-        if (debug == 1){std::cout << "\n\n";}
     }
 
     // In gAlphabet variable, we store the set of all edge labels
     // (not only "a", "b", but also "and"-formulae: "a&b". not "a|b".)
     // Here, we create the alphabet by adding all possible labels using power-set construction
-    if (debug == 1){ std::cout << "Setting the alphabet. "; }
-
     // pow(2, pvwaa->ap().size()) is the amount of all combinations of labels = num of letters in the final alphabet
+    gApVar.clear();
+    for (auto &ap : pvwaa->ap()) {
+        gApVar.push_back(dict->varnum(ap));
+    }
     for (int i = 0; i < pow(2, pvwaa->ap().size()); i++){
         bdd thisbdd = bdd_true();
         // for all digits in the binary form of i
         for (int digit = 0; digit < pvwaa->ap().size(); digit++){
             if ((i & (int)pow(2, digit)) != 0){
                 // add atomic proposition number digit
-                thisbdd = bdd_and(thisbdd, bdd_ithvar(digit));
+                thisbdd = bdd_and(thisbdd, bdd_ithvar(gApVar[digit]));
             } else {
-                thisbdd = bdd_and(thisbdd, bdd_not(bdd_ithvar(digit)));
+                thisbdd = bdd_and(thisbdd, bdd_not(bdd_ithvar(gApVar[digit])));
             }
         }
         gAlphabet.push_back(thisbdd);
     }
 
-    if (debug == 1){
-        std::cout << "It is: ";
-        for (auto letter : gAlphabet){
-            std::cout << letter;
+    // Only the letters satisfying the assumption get to the letter classes and the nondeterministic part
+    bdd assumption = assumption_bdd(dict, pvwaa->ap(), pvwaa.get());
+    gAllowed = BitSet(gAlphabet.size());
+    for (unsigned li = 0; li < gAlphabet.size(); ++li) {
+        if (bdd_implies(gAlphabet[li], assumption)) {
+            gAllowed.insert(li);
         }
-        std::cout << "\n";
     }
 
-    // We now start building the SDBA by removing alternation, which gives us the final nondeterministic part
-    spot::twa_graph_ptr sdba = spot::remove_alternation(pvwaa, true);
-    //spot::twa_graph_ptr sdba = spot::remove_alternation(spot::make_twa_graph(pvwaa, {false, false, false, false, false, false}));
-    bdd_extvarnum(gnvwaa);
-
-    sdba->set_buchi();
-    sdba->prop_state_acc(spot::trival(false));
+    TRACE(VWAA, 2, "The alphabet has " << gAlphabet.size() << " letters, " << gAllowed.count() << " allowed");
 
-    // Number of configurations C (states in the nondeterministic part)
-    gnc = sdba->num_states();
+    // States of the VWAA get their own block of BDD variables for the phis of the deterministic part,
+    // registered in the dictionary after the atomic propositions
+    int stateVarBase = dict->register_anonymous_variables(gnvwaa, &gStateVar);
+    gStateVar = orderStateVars(pvwaa, stateVarBase);
 
-    // Definition of the phis and Rs assigned to the states in the deterministic part, for future
-    std::map<unsigned, std::set<std::string>> Rname;
-    std::map<unsigned, bdd> phi1;
-    std::map<unsigned, bdd> phi2;
-    // State-names C are in style of "1,2,3", these represent states Q of the former VWAA configuration
-    auto sn = sdba->get_named_prop<std::vector<std::string>>("state-names");
-    std::set<std::string> C[gnc];
+    // With -r, BuDDy may sift the state variables whenever the phis grow, the atomic propositions keep their order
+    if (o_reorder) {
+        if (stateVarBase > 0) {
+            bdd_intaddvarblock(0, stateVarBase - 1, BDD_REORDER_FIXED);
+        }
+        bdd_intaddvarblock(stateVarBase, stateVarBase + gnvwaa - 1, BDD_REORDER_FREE);
+        bdd_autoreorder(BDD_REORDER_SIFT);
+    }
 
-    // We mark the Rs of the states of ND part so we differ them from D part states with empty R, phi1 and phi2 later on
-    // We also set all the edges in ND part of SDBA as not-accepting (also to fix odd behavior of remove_alternation)
-    if (debug == 1) { std::cout << "\nRemoving acceptation from all edges in ND part"; }
+    // All the loops below work on the arrays of the flattened VWAA instead of the Spot graph
+    FlatVWAA vwaaf = flattenVWAA(pvwaa);
 
-    for (unsigned ci = 0; ci < gnc; ++ci) {
-        Rname[ci] = {"ND-part state"};
+    for (unsigned q = 0; q < gnvwaa; ++q) {
+        // If there exists a looping, but not accepting outgoing edge, we set this state as Qmay
+        // If we find an outgoing edge, where there is no loop, we set this state as not Qmust
+        isqmay[q] = false;
+        isqmust[q] = true;
+        for (unsigned e = vwaaf.edgeBegin[q]; e < vwaaf.edgeBegin[q + 1]; ++e) {
+            if (vwaaf.loop[e] && !vwaaf.accepting[e]) {
+                isqmay[q] = true;
+            }
+            if (!vwaaf.loop[e]) {
+                isqmust[q] = false;
+            }
+        }
+        TRACE(VWAA, 1, "State " << q << (q == gtnum ? " is the {} state," : "") << (isqmay[q] ? " Qmay" : " not Qmay")
+                       << (isqmust[q] ? ", Qmust" : ", not Qmust"));
+    }
 
-        for (auto &t: sdba->out(ci)) {
-            for (unsigned d: pvwaa->univ_dests(t.dst)) {
-                if (debug == 1) {std::cout << "\nEdge of sdba: " << t.src << "-" << d << " acceptation: " << t.acc << ". "; }
-                t.acc = 0;
-                if (debug == 1) { std::cout << "We set acc to " << t.acc << ". "; }
+    // Letters enabling the same edges lead to the same successors everywhere in the deterministic part,
+    // so we only go through classes of such letters
+    std::unordered_map<BitSet, unsigned> classOf;
+    for (auto li : gAllowed.elements()) {
+        BitSet enabled(vwaaf.guard.size());
+        for (unsigned e = 0; e < vwaaf.guard.size(); ++e) {
+            if (edgeEnabled(vwaaf, e, li)) {
+                enabled.insert(e);
             }
         }
+
+        auto it = classOf.find(enabled);
+        if (it == classOf.end()) {
+            classOf[enabled] = gClassLetter.size();
+            gClassLetter.push_back(li);
+            gClassLabel.push_back(gAlphabet[li]);
+        } else {
+            gClassLabel[it->second] = bdd_or(gClassLabel[it->second], gAlphabet[li]);
+        }
+    }
+    TRACE(VWAA, 2, "The letters form " << gClassLetter.size() << " classes");
+
+    // We now start building the SDBA by removing alternation, which gives us the final nondeterministic part
+    // Configurations C (states of the nondeterministic part) are sets of states Q of the former VWAA
+    // valid[ci] tells whether C[ci] contains only states that are Qmay or reachable from them
+    std::vector<BitSet> C;
+    std::vector<bool> valid;
+    gClosure = computeReachClosures(vwaaf);
+    spot::twa_graph_ptr sdba = spot::make_twa_graph(dict);
+    sdba->copy_ap_of(pvwaa);
+
+    // A VWAA without marks (safety) or where only t loops without a mark (guarantee) does not need
+    // the nondeterministic part nor the choice of R, the whole automaton is the deterministic part
+    bool safety = std::find(vwaaf.accepting.begin(), vwaaf.accepting.end(), true) == vwaaf.accepting.end();
+    bool guarantee = true;
+    for (unsigned q = 0; q < gnvwaa; ++q) {
+        if (q != gtnum && isqmay[q]) {
+            guarantee = false;
+        }
+    }
+    bool weakDeterministic = o_weak_fragments && (safety || guarantee);
+    TRACE(VWAA, 1, "The VWAA is" << (safety ? "" : " not") << " safety and" << (guarantee ? "" : " not") << " guarantee");
+
+    if (weakDeterministic) {
+        gnc = 0;
+        sdba->set_buchi();
+        makeWeakDeterministic(vwaaf, safety, sdba);
+    } else {
+        removeAlternation(vwaaf, gClosure, isqmay, sdba, C, valid);
+
+        sdba->set_buchi();
+
+        // Number of configurations C (states in the nondeterministic part)
+        gnc = sdba->num_states();
     }
-    if (debug == 1) { std::cout << "\n"; }
+    sdba->prop_state_acc(spot::trival(false));
+
+    // Definition of the phis and Rs assigned to the states in the deterministic part, for future
+    // States of the ND part have none of them, so we only look for D part states among states gnc and higher
+    // There is a pair of phis for each obligation group of R (see obligationGroups)
+    std::map<unsigned, BitSet> Rname;
+    std::map<unsigned, std::vector<Phi>> phi1;
+    std::map<unsigned, std::vector<Phi>> phi2;
 
     // Choosing the R
 
     // We go through all the states in C
     // In each one, we go through all its Q-s and build all possible R-s based on what types of states Q-s are
     // For each R - if it is a new R, we build an R-component
+    // (there are no C for the weak deterministic automaton)
     for (unsigned ci = 0; ci < gnc; ++ci) {
 
-        // We parse the statename ((*sn)[ci]) to create a set of states
-        if (sn && ci < sn->size() && !(*sn)[ci].empty()) {
-            std::string s = ((*sn)[ci]) + ",";
-            std::string delimiter = ",";
-            size_t pos = 0;
-            std::string token;
-            while ((pos = s.find(delimiter)) != std::string::npos) {
-                token = s.substr(0, pos);
-                C[ci].insert(token);
-                s.erase(0, pos + delimiter.length());
-            }
-        } else {
-            std::cout << "Wrong C state name."; // This should never happen.
+        TRACE(RCOMP, 1, "Configuration " << ci << " = " << C[ci] << (valid[ci] ? " is valid" : " is not valid"));
+        // Only states reachable from Qmays may be in C, this was checked when C was created.
+        // If it is not so, this configuration can not contain an R.
+        if (valid[ci]){
+            // We call this function to judge Q-s of this C and create R-s and R-components based on them
+            createDetPart(vwaaf, ci, C[ci], C[ci], BitSet(gnvwaa), isqmay, isqmust, sdba, Rname, phi1, phi2);
         }
-        if (((*sn)[ci]).compare("{}") == 0){
-            if (debug == 1) { std::cout << "\nStarting check of configuration of state {}, renaming state to: " << std::to_string(gtnum); }
-            ((*sn)[ci]) = std::to_string(gtnum);
-            C[ci].clear();
-            C[ci].insert(std::to_string(gtnum));
+    }
+
+
+#ifdef LTL2SDBA_TRACE
+    // Recapitulation of all the states and their phis
+    for (unsigned c = 0; c < sdba->num_states(); ++c) {
+        if (c < gnc) {
+            TRACE(CONF, 1, "State " << c << " = " << C[c]);
+        } else {
+            TRACE(SUCC, 1, "State " << c << ": R " << Rname[c] << ", phi1 " << phi1[c] << ", phi2 " << phi2[c]);
         }
+    }
+#endif
 
-        std::set<std::string> R;
 
-        if (debug == 1){
-            std::cout << "\nChecking if configuration " << ci << " = {";
-            for (auto x : C[ci]){
-                std::cout << " " << x;
-            }
-            std::cout << " } contains only valid states.\n";
+    if (o_stats) {
+        if (weakDeterministic) {
+            std::cerr << "weak deterministic automaton for a " << (safety ? "safety" : "guarantee") << " VWAA\n";
         }
-        // Check if only states reachable from Qmays are in C. If not, this configuration can not contain an R.
-        if (checkMayReachableStates(pvwaa, C[ci], R, isqmay)){  // We are using R just as a placeholder empty set here
-            R.clear();
-            if (debug == 1){std::cout << "Yes! \n";}
-            // We call this function to judge Q-s of this C and create R-s and R-components based on them
-            createDetPart(pvwaa, ci, C[ci], C[ci], R, isqmay, isqmust, sdba, Rname, phi1, phi2);
+        std::cerr << "letters: " << gAlphabet.size() << " (" << gAllowed.count() << " allowed), letter classes: " << gClassLetter.size()
+                  << "\nsuccessor cache: " << gSuccLookups << " lookups, " << gSuccHits << " hits";
+        if (gSuccLookups > 0) {
+            std::cerr << " (" << 100 * gSuccHits / gSuccLookups << "%)";
         }
+        std::cerr << ", " << gSuccCache.size() << " entries\n";
     }
 
-
-    if (debug == 1) {
-        std::cout << "\nRECAPITULATION of states and phis";
-        for (unsigned c = 0; c < sdba->num_states(); ++c) {
-            std::cout << "\nC: " << c;
-            if (c < gnc){
-                std::cout << " = {";
-                for (auto x : C[c]) {
-                    std::cout << " " << x;
-                }
-                std::cout << " }";
-            } else {
-                std::cout << " Rname: ";
-                for (auto x : Rname[c]) {
-                    std::cout << x << ", ";
+    // Each obligation group has its own mark, R-components with fewer groups than the others
+    // get the marks of the missing groups on all their edges
+    unsigned nmarks = 1;
+    for (auto &phis : phi1) {
+        nmarks = std::max(nmarks, (unsigned) phis.second.size());
+    }
+    if (nmarks > 1) {
+        for (auto &t : sdba->edges()) {
+            if (t.src >= gnc) {
+                for (unsigned g = phi1[t.src].size(); g < nmarks; ++g) {
+                    t.acc.set(g);
                 }
-                std::cout << "phi1: " << (bdd) phi1[c] << ", phi2: " << (bdd) phi2[c];
-
             }
         }
-        std::cout << "\n\n";
     }
 
+    if (o_reorder) {
+        // We go back to the order of the variables by their numbers, which the next translation expects
+        bdd_autoreorder(BDD_REORDER_NONE);
+        bdd_clrvarblocks();
+        std::vector<int> order(bdd_varnum());
+        for (unsigned v = 0; v < order.size(); ++v) {
+            order[v] = v;
+        }
+        bdd_setvarorder(order.data());
+    }
+    dict->unregister_all_my_variables(&gStateVar);
+
+    // Equivalent states of the deterministic part are merged, also across R-components
+    // The edges are already merged by EdgeAccumulator, so only the minimization may need merge_edges
+    unsigned ndet = sdba->num_states() - gnc;
+    minimizeDetPart(sdba);
+    if (o_stats) {
+        std::cerr << "deterministic part: " << ndet << " states, " << sdba->num_states() - gnc
+                  << " after minimization\n";
+    }
 
-    // Call spot's merge edges function
-    sdba->merge_edges();
-
-    sdba->set_buchi();
+    if (nmarks > 1) {
+        sdba->set_generalized_buchi(nmarks);
+    } else {
+        sdba->set_buchi();
+    }
     sdba->prop_state_acc(spot::trival(false));
-
-    // Automaton is universal if the conjunction between the labels of two transitions leaving a state is
-    // always false.
-    sdba->prop_universal(spot::trival());
-    // automaton is complete if for each state the union of the labels of its outgoing transitions
-    // is always true.
-    sdba->prop_complete(spot::trival());
+    setProperties(sdba, gnc);
 
     return sdba;
 }
 
-bool checkMayReachableStates(std::shared_ptr<spot::twa_graph> vwaa, std::set<std::string> Conf,
-                             std::set<std::string> Valid, bool isqmay[]){
-
-    // We check each state whether it is Qmay. If it is, we add it to Valid with all successors
-    for (auto q : Conf)
-    {
-        if (q.empty() || !isdigit(q.at(0))){
-            std::cout << "We are in BADSTATE: " << q << ". "; // This should never happen.
-        } else {
-            if (isqmay[std::stoi(q)]) {
-                addToValid(vwaa, q, Valid);
+void setProperties(spot::twa_graph_ptr &sdba, unsigned detPart){
+    // All marks are in the deterministic part, which starts at detPart and has no edge back
+    sdba->prop_semi_deterministic(true);
+    sdba->set_named_prop("deterministic-part", new unsigned(detPart), [](void *p) noexcept {
+        delete static_cast<unsigned *>(p);
+    });
+
+    // Automaton is universal (deterministic) if the conjunction between the labels of two transitions leaving
+    // a state is always false, the states of the deterministic part have an edge for each class of letters at most.
+    // Automaton is complete if for each state the union of the labels of its outgoing transitions is always true.
+    bool deterministic = true;
+    bool complete = true;
+    for (unsigned s = 0; s < sdba->num_states(); ++s) {
+        bdd covered = bdd_false();
+        for (auto &t : sdba->out(s)) {
+            if (s < detPart && deterministic && bdd_and(covered, t.cond) != bdd_false()) {
+                deterministic = false;
             }
+            covered = bdd_or(covered, t.cond);
+        }
+        if (covered != bdd_true()) {
+            complete = false;
         }
     }
-
-    // We check and return whether all states in Conf are valid (QMays and their successors)
-    for (auto q : Conf)
-    {
-        if (!(Valid.find(q) != Valid.end())){
-            return false;
+    sdba->prop_universal(deterministic);
+    sdba->prop_complete(complete);
+
+    // Automaton is weak if in each SCC either all edges have all marks, or no edge has a mark;
+    // otherwise, we do not know (the cycles might still be all accepting or all rejecting)
+    spot::scc_info si(sdba);
+    auto all = sdba->acc().all_sets();
+    // 1 for edges without marks, 2 for edges with all marks, 4 for the others
+    std::vector<unsigned> kinds(si.scc_count(), 0);
+    for (auto &t : sdba->edges()) {
+        unsigned scc = si.scc_of(t.src);
+        if (scc == si.scc_of(t.dst)) {
+            kinds[scc] |= !t.acc ? 1 : (t.acc == all ? 2 : 4);
         }
     }
-    return true;
-}
-
-void addToValid(std::shared_ptr<spot::twa_graph> vwaa, std::string q, std::set<std::string> &Valid){
-    Valid.insert(q);
-    // We add into Valid all states reachable from q too
-    for (auto &t: vwaa->out((unsigned int)std::stoi(q))) {
-        for (unsigned d: vwaa->univ_dests(t.dst)) {
-            // We exclude loops for effectivity, as they never need to be checked to be added again
-            if (std::to_string(d) != q) {
-                addToValid(vwaa, std::to_string(d), Valid);
+    for (auto kind : kinds) {
+        if (kind == 3 || kind >= 4) {
+            return;
+        }
+    }
+    sdba->prop_weak(true);
+
+    // A weak automaton is terminal if its accepting SCCs are complete and do not lead to rejecting ones
+    bool terminal = true;
+    for (unsigned s = 0; s < sdba->num_states() && terminal; ++s) {
+        unsigned scc = si.scc_of(s);
+        if (kinds[scc] != 2) {
+            continue;
+        }
+        bdd covered = bdd_false();
+        for (auto &t : sdba->out(s)) {
+            if (si.scc_of(t.dst) == scc) {
+                covered = bdd_or(covered, t.cond);
+            } else if (kinds[si.scc_of(t.dst)] != 2) {
+                terminal = false;
             }
         }
+        terminal = terminal && covered == bdd_true();
     }
+    sdba->prop_terminal(terminal);
 }
 
-void createDetPart(std::shared_ptr<spot::twa_graph> vwaa, unsigned ci, std::set<std::string> Conf,
-                   std::set<std::string> remaining, std::set<std::string> R, bool isqmay[], bool isqmust[],
-                   spot::twa_graph_ptr &sdba, std::map<unsigned, std::set<std::string>> &Rname,
-                   std::map<unsigned, bdd> &phi1, std::map<unsigned, bdd> &phi2){
+void makeWeakDeterministic(const FlatVWAA &vwaa, bool safety, spot::twa_graph_ptr &sdba){
 
-    // We choose first q that comes into way
-    auto it = remaining.begin();
-    std::string q;
-    if (it != remaining.end()) q = *it;
+    TRACE_SCOPE(SUCC, "makeWeakDeterministic");
 
-    if (debug == 1){std::cout << "\nFunction createDetPart.\nWe chose q: " << q << ". ";}
-    // Erase it from remaining as we are checking it now
-    remaining.erase(q);
+    // States are the phis of the VWAA without R, all edges are taken by the m.t. relation
+    BitSet none(gnvwaa);
+    std::vector<Phi> phis = { vwaa.init.empty() ? Phi::truth() : conjunctionOfStates(vwaa.init) };
+    gDetIndex.emplace(DetState{ none, phis, {} }, 0);
+    sdba->set_init_state(sdba->new_state());
 
-    // Checking state correctness
-    if (q.empty() || !isdigit(q.at(0))){
-        std::cout << "We are in BADSTATE: " << q << ". "; // This should never happen.
-    } else {
-        // If this state is Qmust, we add it (and don't have to check Qmay)
-        if (isqmust[std::stoi(q)]){
-            if (debug == 1){std::cout << "It is Qmust, adding to R. ";}
-            if (R.count(q) == 0) {
-                R.insert(q);
+    EdgeAccumulator edges;
+    for (unsigned s = 0; s < phis.size(); ++s) {
+        // Phis are pushed back, so we copy the one we work with
+        Phi phi = phis[s];
+        TRACE(SUCC, 1, "State " << s << ": phi " << phi);
+
+        // All runs of a safety VWAA accept, a run of a guarantee VWAA accepts once all its branches reach t
+        spot::acc_cond::mark_t accepting = {};
+        if (safety || phi.isTrue()) {
+            accepting.set(0);
+        }
+
+        for (unsigned lc = 0; lc < gClassLetter.size(); ++lc) {
+            Phi succ = succPhi(vwaa, none, none, phi, lc, false);
+            if (succ.isFalse()) {
+                continue;
             }
-        } else {
-            // If it is Qmay, we recursively call the function and try both adding it and not
-            if (isqmay[std::stoi(q)]){
-                if (debug == 1){std::cout << "It is Qmay (and not Qmust!), adding to R";}
-
-                // We create a new branch with new R and add the state q to this R
-                std::set<std::string> Rx = R;
-                if (Rx.count(q) == 0) {
-                    Rx.insert(q);
-                }
 
-                if (!remaining.empty()){
-                    // We run the branch that builds the R where this state is added
-                    if (debug == 1){std::cout << " and creating branch including: " << q << ".\n";}
-                    createDetPart(vwaa, ci, Conf, remaining, Rx, isqmay, isqmust, sdba, Rname, phi1, phi2);
-                } else{
-                    // If this was the last state, we have one R complete. Let's build an R-component from it.
-                    if (debug == 1){std::cout << " and this was lastx state!\n----------> \nCreate Rx comp: \n";}
-                    createRComp(vwaa, ci, Conf, Rx, sdba, Rname, phi1, phi2);
-                }
-                // We also continue this run without adding this state to R - representing the second branch
-                if (debug == 1){std::cout<< "Also continuing for not adding q to R - ";}
+            unsigned succStateNum = gDetIndex.emplace(DetState{ none, { succ }, {} }, phis.size()).first->second;
+            if (succStateNum == phis.size()) {
+                sdba->new_state();
+                phis.push_back(succ);
+                TRACE(SUCC, 2, "New state " << succStateNum << ": phi " << succ);
             }
+
+            TRACE(SUCC, 3, "Edge " << s << "-" << succStateNum << " labeled " << gClassLabel[lc] << ", acc " << accepting);
+            edges.add(succStateNum, accepting, gClassLabel[lc]);
         }
-        if (debug == 1){std::cout << "Done checking for q: " << q;}
 
-    }
-    if (debug == 1){std::cout << "\n Is this last state? ";}
-    // If this was the last state, we have this R complete. Let's build an R-component from it.
-    if (remaining.empty()){
-        if (debug == 1){std::cout << " YES!  \n----------> \nCreate R comp: \n";}
-        createRComp(vwaa, ci, Conf, R, sdba, Rname, phi1, phi2);
-    } else{
-        if (debug == 1){std::cout << " NO! Check another: \n";}
-        createDetPart(vwaa, ci, Conf, remaining, R, isqmay, isqmust, sdba, Rname, phi1, phi2);
+        edges.flush(sdba, s);
     }
 }
 
-void createRComp(std::shared_ptr<spot::twa_graph> vwaa, unsigned ci, std::set<std::string> Conf,
-                 std::set<std::string> R, spot::twa_graph_ptr &sdba, std::map<unsigned, std::set<std::string>> &Rname,
-                 std::map<unsigned, bdd> &phi1, std::map<unsigned, bdd> &phi2){
-    if (debug == 1){ std::cout << "\n~~~~~~Beginning of function createRComp:"; }
+void removeAlternation(const FlatVWAA &vwaa, const std::vector<BitSet> &closure, bool isqmay[],
+                       spot::twa_graph_ptr &sdba, std::vector<BitSet> &C, std::vector<bool> &valid){
 
-    // The phis of this state
-    bdd p1;
-    bdd p2;
+    TRACE_SCOPE(CONF, "removeAlternation");
 
-    // To distinguish between an empty bdd and a bdd containing "false", we create these bools
-    bool p1empty;
-    bool p2empty;
+    // For each edge, we need the letters enabling it; above gMaxTableAps, they are not in the flattened VWAA
+    std::vector<BitSet> computedLetters;
+    if (vwaa.letters.empty()) {
+        for (unsigned e = 0; e < vwaa.guard.size(); ++e) {
+            computedLetters.emplace_back(gAlphabet.size());
+            for (unsigned li = 0; li < gAlphabet.size(); ++li) {
+                if (bdd_implies(gAlphabet[li], vwaa.guard[e])) {
+                    computedLetters.back().insert(li);
+                }
+            }
+        }
+    }
+    const std::vector<BitSet> &letters = vwaa.letters.empty() ? computedLetters : vwaa.letters;
 
-    // First we construct the edges from C into the R component by getting the correct phi1 and phi2
+    const BitSet &allLetters = gAllowed;
 
-    // For each edge label ("a,b,c", "a,b,!c", "a,!b,c"...) of the alphabet
-    for (auto label : gAlphabet){
+    // Numbers of the configurations we have already found
+    std::unordered_map<BitSet, unsigned> confnum;
+    // The names of the configurations, not built with --no-names
+    std::vector<std::string> *names = o_no_names ? nullptr : new std::vector<std::string>();
 
-        if (debug == 1) {
-            std::cout << "\n\n---For Conf: ";
-            for (auto x : Conf){
-                std::cout << x << ",";
-            }
-            std::cout << " R: ";
-            for (auto y : R){
-                std::cout << y << ",";
+    // Returns the number of the configuration conf, creating a new state for it if needed
+    auto getConf = [&](BitSet conf) -> unsigned {
+        // The empty configuration is represented by the state t
+        if (conf.empty() && gtnum != -1U) {
+            conf.insert(gtnum);
+        }
+
+        auto it = confnum.find(conf);
+        if (it != confnum.end()) {
+            return it->second;
+        }
+
+        unsigned ci = sdba->new_state();
+        confnum[conf] = ci;
+        C.push_back(conf);
+        // We check right away whether only states reachable from Qmays are in this configuration
+        valid.push_back(checkMayReachableStates(conf, closure, isqmay));
+
+        std::string name;
+        if (names != nullptr || trace::enabled(trace::CONF, 1)) {
+            for (auto q : conf.elements()) {
+                name += (name.empty() ? "" : ",") + std::to_string(q);
             }
-            std::cout << " starting createRcomp loop under label: " << label << "\n";
+        }
+        if (names != nullptr) {
+            names->push_back(name);
         }
 
-        p1 = bdd_false();
-        p2 = bdd_false();
+        TRACE(CONF, 1, "New configuration " << ci << " = {" << name << "}" << (valid.back() ? ", valid" : ""));
+        return ci;
+    };
 
-        // We mark both phis as empty
-        p1empty = true;
-        p2empty = true;
+    sdba->set_init_state(getConf(vwaa.init));
 
-        for (unsigned q = 0; q < gnvwaa; ++q) {
+    // Configurations are numbered in the order they are found, so we simply go through them until no new one appears;
+    // this is breadth-first, not in the topological order of SCCs, as nothing later depends on the numbering
+    // and ordering the SCCs would need a second pass renumbering the states of sdba
+    for (unsigned ci = 0; ci < C.size(); ++ci) {
+        BitSet conf = C[ci];
 
-            if (debug == 1) { std::cout << "\nChecking q: " << q << " (for label: " << label << ") to add to phis: "; }
+        // Labels of the edges leaving ci, accumulated over all successors
+        std::map<unsigned, bdd> succlabels;
 
-            // We check all states of Conf
-            if (Conf.find(std::to_string(q)) != Conf.end()){
+        // Successor configurations are built by choosing one edge for each state of conf,
+        // together with the letters enabling all the chosen edges
+        std::vector<std::pair<BitSet, BitSet>> succs = { std::make_pair(BitSet(gnvwaa), allLetters) };
 
-                // For each such state, we add its successors through m.t. to phi1 using and
-                if (debug == 1) { std::cout << "\n  It is in conf. Adding its m.t.-successors under this label to phi1."; }
+        for (auto q : conf.elements()) {
+            // The state t loops under every letter, it does not add anything
+            if (q == gtnum) {
+                continue;
+            }
 
-                if (p1 == bdd_false()) {
-                    // If the bdd is false, we only add if it's empty
-                    if (p1empty){
-                        if (debug == 1) { std::cout << "\n  P1 is empty. Adding succ of this q to p1 even though it is false currently."; }
-                        p1empty = false;
-                        p1 = getqSuccs(vwaa, Conf, R, q, label);
+            std::vector<std::pair<BitSet, BitSet>> newsuccs;
+            for (auto &succ : succs) {
+                for (unsigned e = vwaa.edgeBegin[q]; e < vwaa.edgeBegin[q + 1]; ++e) {
+                    BitSet succletters = succ.second & letters[e];
+                    if (!succletters.empty()) {
+                        newsuccs.emplace_back(succ.first | vwaa.dests[e], succletters);
                     }
-                } else {
-                    p1 = bdd_and(p1, getqSuccs(vwaa, Conf, R, q, label));
-                }
-                if (debug == 1) { std::cout << "\n  Added all m.t.-successors under this label to phi1. Got: " << p1; }
-            }
-
-            // We add all q-s of R to phi2
-            if (R.find(std::to_string(q)) != R.end()) {
-                if (debug == 1) { std::cout << "\n  q is in R, adding q to phi2."; }
-                if (p2 == bdd_false()) {
-                    // If the bdd is false, we only add if it's empty
-                    if (p2empty){
-                        if (debug == 1) { std::cout << "\n  P2 is empty. Adding q to p2 even though it is false currently."; }
-                        p2empty = false;
-                        p2 = bdd_ithvar(q);
-                    }
-                } else {
-                    p2 = bdd_and(p2, bdd_ithvar(q));
                 }
             }
-            if (debug == 1) { std::cout << "\n"; }
-        }
+            minimizeConfs(newsuccs);
+            succs.swap(newsuccs);
 
-        if (debug == 1) {
-            std::cout << "\nTo be sure, states of R: ";
-            for (auto y : R) {
-                std::cout << y << ", ";
+            // No choice of edges is enabled under any letter, so there is no successor
+            if (succs.empty()) {
+                break;
             }
         }
 
-        // We now substitute all states succp1 of R with true
-        if (debug == 1) {  std::cout << "Replacing all states of phi1 (" << p1 << ") in R with true.\n"; }
-        p1 = subStatesOfRWithTrue(p1, R);
-        if (debug == 1) {
-            std::cout << "\nThe phis we just made: phi1: " << p1 << ", phi2: " << p2 << " (for R: ";
-            for (auto x : R){
-                std::cout << x << ", ";
+        for (auto &succ : succs) {
+            bdd label = bdd_false();
+            for (auto li : succ.second.elements()) {
+                label = bdd_or(label, gAlphabet[li]);
+            }
+
+            unsigned succnum = getConf(succ.first);
+            auto it = succlabels.find(succnum);
+            if (it == succlabels.end()) {
+                succlabels[succnum] = label;
+            } else {
+                it->second = bdd_or(it->second, label);
             }
-            std::cout << ")\n";
         }
 
+        for (auto &succlabel : succlabels) {
+            sdba->new_edge(ci, succlabel.first, succlabel.second);
+        }
+    }
 
-        // We need to check if this R-component state exists already
-        // addedStateNum is the number of the state if it exists, else value remains as a "new state" number:
-        unsigned addedStateNum = sdba->num_states();
-        if (debug == 1) { std::cout << "Checking if the R-comp with same R, phi1 and phi2 exists. ";}
+    if (names != nullptr) {
+        sdba->set_named_prop("state-names", names);
+    }
+}
 
-        for (unsigned c = 0; c < sdba->num_states(); ++c) {
-            if (Rname[c] == R && phi1[c] == p1 && phi2[c] == p2){
-                addedStateNum = c;
-                if (debug == 1) { std::cout << " It exists!"; }
-                break;
-            }
+void minimizeConfs(std::vector<std::pair<BitSet, BitSet>> &confs){
+    // We first join the letters of equal configurations
+    std::unordered_map<BitSet, unsigned> index;
+    std::vector<std::pair<BitSet, BitSet>> joined;
+    for (auto &conf : confs) {
+        auto it = index.find(conf.first);
+        if (it == index.end()) {
+            index[conf.first] = joined.size();
+            joined.push_back(conf);
+        } else {
+            joined[it->second].second |= conf.second;
         }
+    }
 
-        if (debug == 1) { std::cout << "\nThe statenum is: " << addedStateNum << "\n";}
-
-        // If phi1 is false, all the followers will be false too and no state will be accepting, so we don't need to try.
-        if (p1 != bdd_false()) {
-            // If the state doesn't exist yet, we create it with "sdba->num_states()-1" becoming its new number.
-            if (addedStateNum == sdba->num_states()) {
-                if (debug == 1) {
-                    std::cout << "\nThis state is new, creating it, with edge from C" << ci << " to C"
-                              << addedStateNum << " labeled " << label;
-                }
-                sdba->new_state(); // addedStateNum is now equal to sdba->num_states()-1
-                Rname[sdba->num_states() - 1] = R;
-                phi1[sdba->num_states() - 1] = p1;
-                phi2[sdba->num_states() - 1] = p2;
-                sdba->new_edge(ci, addedStateNum, label, {});
-                //bdd_extvarnum(1);
+    // Under a letter, conf i is left out if a proper subset of it is also a successor
+    std::vector<std::pair<BitSet, BitSet>> result;
+    for (unsigned i = 0; i < joined.size(); ++i) {
+        BitSet letters = joined[i].second;
+        for (unsigned j = 0; j < joined.size() && !letters.empty(); ++j) {
+            if (i != j && joined[j].first.is_subset_of(joined[i].first)) {
+                letters -= joined[j].second;
+            }
+        }
+        if (!letters.empty()) {
+            result.emplace_back(joined[i].first, letters);
+        }
+    }
+    confs.swap(result);
+}
 
-            } else {
-                bool connected = false;
-                // If the state already exists, we check if there is an edge leading there from the current state
-                for (auto &t: sdba->out(ci)) {
-                    // If there is such an edge, we add this label via "OR" to the bdd
-                    if (t.dst == addedStateNum) {
-                        if (debug == 1) {
-                            std::cout << "Adding new label to the edge under OR: " << t.src << "-" << t.dst
-                                      << " bdd:" << t.cond << " label: " << label << ". \n";
+std::vector<BitSet> computeReachClosures(const FlatVWAA &vwaa){
+    std::vector<BitSet> closure(gnvwaa, BitSet(gnvwaa));
+
+    // 0 = not visited yet, 1 = successors are being processed, 2 = closure is complete
+    std::vector<unsigned> status(gnvwaa, 0);
+    std::vector<unsigned> stack;
+
+    // We compute closures in postorder of a DFS, that is in reverse topological order of SCCs
+    // As the automaton is very weak, all SCCs are single states and a closure is complete
+    // once the closures of all other successors are
+    for (unsigned root = 0; root < gnvwaa; ++root) {
+        stack.push_back(root);
+        while (!stack.empty()) {
+            unsigned q = stack.back();
+            if (status[q] == 0) {
+                status[q] = 1;
+                closure[q].insert(q);
+                for (unsigned e = vwaa.edgeBegin[q]; e < vwaa.edgeBegin[q + 1]; ++e) {
+                    for (unsigned d = vwaa.dests[e].first(); d != -1U; d = vwaa.dests[e].next(d + 1)) {
+                        if (status[d] == 0) {
+                            stack.push_back(d);
                         }
-                        connected = true;
-                        t.cond = bdd_or(t.cond, label);
                     }
                 }
-                // If there isn't such an edge, we create a new one
-                if (!connected) {
-                    // We connect the state to this configuration under the currently checked label
-                    if (debug == 1) {
-                        std::cout << "New edge from C" << ci << " to C" << addedStateNum << " labeled "
-                                  << label;
+            } else {
+                if (status[q] == 1) {
+                    for (unsigned e = vwaa.edgeBegin[q]; e < vwaa.edgeBegin[q + 1]; ++e) {
+                        for (unsigned d = vwaa.dests[e].first(); d != -1U; d = vwaa.dests[e].next(d + 1)) {
+                            if (d != q) {
+                                closure[q] |= closure[d];
+                            }
+                        }
                     }
-                    sdba->new_edge(ci, addedStateNum, label, {});
+                    status[q] = 2;
                 }
+                stack.pop_back();
             }
+        }
+    }
 
-            // If the state is new, add all successors of this state to the SDBA and connect them
-            if (addedStateNum == sdba->num_states() - 1) {
-                if (debug == 1) { std::cout << "\nAs the state is new, adding all succs"; }
-                addRCompStateSuccs(vwaa, sdba, addedStateNum, Conf, Rname, phi1, phi2);
-            }
+    return closure;
+}
 
-        } else {
-            if (debug == 1) { std::cout << "\nPhi1 is false, so we are not adding this state.\n";}
+bool checkMayReachableStates(const BitSet &Conf, const std::vector<BitSet> &closure, bool isqmay[]){
+    // Valid = States marked as QMay and their successors
+    BitSet Valid(gnvwaa);
+    for (auto q : Conf.elements()) {
+        if (isqmay[q]) {
+            Valid |= closure[q];
         }
     }
+
+    // We check and return whether all states in Conf are valid
+    return Conf.is_subset_of(Valid);
 }
 
+void createDetPart(const FlatVWAA &vwaa, unsigned ci, const BitSet &Conf, BitSet remaining, BitSet R,
+                   bool isqmay[], bool isqmust[], spot::twa_graph_ptr &sdba, std::map<unsigned, BitSet> &Rname,
+                   std::map<unsigned, std::vector<Phi>> &phi1, std::map<unsigned, std::vector<Phi>> &phi2){
 
-// Adds successors of state statenum (and their successors, recursively)
-void addRCompStateSuccs(std::shared_ptr<spot::twa_graph> vwaa, spot::twa_graph_ptr &sdba, unsigned statenum,
-                        std::set<std::string> Conf, std::map<unsigned, std::set<std::string>> &Rname,
-                        std::map<unsigned, bdd> &phi1, std::map<unsigned, bdd> &phi2){
+    // We choose first q that comes into way
+    unsigned q = remaining.first();
 
-    if (debug == 1){
-        std::cout << "\n\n__Beginning addRCompStateSuccs for Conf: ";
-        for (auto x : Conf){
-            std::cout << x << ", ";
-        }
-        std::cout << ". Checking succs of " << statenum << " - R: ";
-        for (auto x : Rname[statenum]){
-            std::cout << x << ", ";
+    // Checking state correctness
+    if (q == -1U){
+        std::cerr << "We are in BADSTATE: " << q << ".\n"; // This should never happen.
+        return;
+    }
+
+    // Erase it from remaining as we are checking it now
+    remaining.erase(q);
+
+    // If this state is Qmust, we add it (and don't have to check Qmay)
+    if (isqmust[q]){
+        TRACE(RCOMP, 2, "Configuration " << ci << ": " << q << " is Qmust, it is in R");
+        R.insert(q);
+    } else {
+        // If it is Qmay, we recursively call the function and try both adding it and not
+        if (isqmay[q]){
+            TRACE(RCOMP, 2, "Configuration " << ci << ": " << q << " is Qmay, branching on it being in R");
+
+            // We create a new branch with new R and add the state q to this R
+            BitSet Rx = R;
+            Rx.insert(q);
+
+            if (!remaining.empty()){
+                // We run the branch that builds the R where this state is added
+                createDetPart(vwaa, ci, Conf, remaining, Rx, isqmay, isqmust, sdba, Rname, phi1, phi2);
+            } else{
+                // If this was the last state, we have one R complete. Let's build an R-component from it.
+                createRComp(vwaa, ci, Conf, Rx, sdba, Rname, phi1, phi2);
+            }
+            // We also continue this run without adding this state to R - representing the second branch
         }
-        std::cout << "phi1: " << phi1[statenum] << ", phi2: " << phi2[statenum] << ")\n";
     }
+    // If this was the last state, we have this R complete. Let's build an R-component from it.
+    if (remaining.empty()){
+        createRComp(vwaa, ci, Conf, R, sdba, Rname, phi1, phi2);
+    } else{
+        createDetPart(vwaa, ci, Conf, remaining, R, isqmay, isqmust, sdba, Rname, phi1, phi2);
+    }
+}
 
-    // The R and phis of the state we are adding successors of
-    std::set<std::string> R = Rname[statenum];
-    bdd p1 = phi1[statenum];
-    bdd p2 = phi2[statenum];
+void createRComp(const FlatVWAA &vwaa, unsigned ci, const BitSet &Conf, const BitSet &R,
+                 spot::twa_graph_ptr &sdba, std::map<unsigned, BitSet> &Rname,
+                 std::map<unsigned, std::vector<Phi>> &phi1, std::map<unsigned, std::vector<Phi>> &phi2){
+    TRACE(RCOMP, 1, "R-component of configuration " << ci << " = " << Conf << " with R " << R);
 
-    // The phis for the successor state (will reset for each added state)
-    bdd succp1;
-    bdd succp2;
+    // Each obligation group of R has its own breakpoint, there is only one group without -g
+    const std::vector<BitSet> &groups = obligationGroups(R);
 
+    // The phi1 of this state
+    Phi p1;
 
-    // For each edge label of the alphabet we compute phis of the reached state (succp1 and succp2)
-    for (auto label : gAlphabet) {
+    // The edges from ci into the R-component and the states they reach for the first time
+    EdgeAccumulator edges;
+    std::vector<unsigned> added;
 
-        if (debug == 1) { std::cout << "\n\n   In addRCompStateSuccs loop for state " << statenum << ", checking label: " << label << "\n"; }
-        succp1 = p1;
-        succp2 = p2;
+    // First we construct the edges from C into the R component by getting the correct phi1 and phi2
 
-        if (debug == 1) { std::cout << ">Replacing all states of succphi1 (" << succp1 << ") with their successors:\n"; }
-        s_bddPair* pair = bdd_newpair();
-        for (unsigned q = 0; q < gnvwaa; q++){
-            // For each state q in succphi1
-            if (debug == 1) { std::cout << "\nchecking if succp1" << succp1 << " implies q " << q << " (" << bdd_ithvar(q) << ")."; }
+    // For each class of letters ("a,b,c", "a,b,!c", "a,!b,c"...) of the alphabet
+    for (unsigned lc = 0; lc < gClassLetter.size(); ++lc){
+        unsigned li = gClassLetter[lc];
+        bdd label = gClassLabel[lc];
 
-            // "if (bdd_implies(succp1, bdd_ithvar(q)))" is not enough if succp1 contains disjunctions, so we use handlers
-            gImplies = false;
-            gLabel = q;
-            bdd_allsat(succp1, allSatImpliesHandler);
-            if (gImplies){
-                if (debug == 1) { std::cout << " yes"; }
-                s_bddPair* newPair = bdd_newpair();
-                bdd_setbddpair(newPair, q, getqSuccs(vwaa, Conf, R, q, label));
-                pair = bdd_mergepairs(pair, newPair);
-            }
+        // For each state of Conf, we add its successors through m.t. to phi1 using and (Conf is never empty)
+        p1 = Phi::truth();
+        for (auto q : Conf.elements()) {
+            p1 = p1 & qSuccs(vwaa, Conf, R, q, li);
+            TRACE(RCOMP, 3, "Phi1 after adding the successors of " << q << " under " << label << ": " << p1);
         }
-        // Replace all first parts of pairs with the second (replacing all q-s with their successors)
-        succp1 = bdd_veccompose(succp1, pair);
-        if (debug == 1) { std::cout << ">New succphi1:" << succp1 << "\n"; }
 
-        // Substitute states succp1 of R with true
-        succp1 = subStatesOfRWithTrue(succp1, R);
+        // We now substitute all states succp1 of R with true
+        p1 = subStatesOfRWithTrue(p1, R);
+
+        // The first group waits for phi1, the other ones start with their breakpoint already reached;
+        // phi2 of each group are all its q-s of R
+        std::vector<Phi> p1s(groups.size(), Phi::truth());
+        std::vector<Phi> p2s;
+        p1s[0] = p1;
+        for (auto &group : groups) {
+            p2s.push_back(conjunctionOfStates(group));
+        }
+        TRACE(RCOMP, 2, "Under " << label << ": phi1 " << p1s << ", phi2 " << p2s);
 
-        if (debug == 1) { std::cout << ">Edited succphi1:" << succp1 << "\n"; }
 
-        // The same for succphi2 (except substituting states of R with true)
-        if (debug == 1) { std::cout << "Replacing all states of succphi2 (" << succp2 << ") with their successors:\n"; }
-        pair = bdd_newpair();
-        for (unsigned q = 0; q < gnvwaa; q++){
+        // If phi1 is false, all the followers will be false too and no state will be accepting, so we don't need to try.
+        if (!p1.isFalse()) {
+            // We need to check if this R-component state exists already
+            // addedStateNum is the number of the state if it exists, else value remains as a "new state" number:
+            unsigned addedStateNum = gDetIndex.emplace(DetState{ R, p1s, p2s }, sdba->num_states()).first->second;
 
-            gImplies = false;
-            gLabel = q;
-            bdd_allsat(succp2, allSatImpliesHandler);
-            if (gImplies){
-                s_bddPair* newPair = bdd_newpair();
-                bdd_setbddpair(newPair, q, getqSuccs(vwaa, Conf, R, q, label));
-                pair = bdd_mergepairs(pair, newPair);
+            // If the state doesn't exist yet, we create it with "sdba->num_states()-1" becoming its new number.
+            if (addedStateNum == sdba->num_states()) {
+                TRACE(RCOMP, 2, "New state " << addedStateNum);
+                sdba->new_state(); // addedStateNum is now equal to sdba->num_states()-1
+                Rname[addedStateNum] = R;
+                phi1[addedStateNum] = p1s;
+                phi2[addedStateNum] = p2s;
+                added.push_back(addedStateNum);
             }
+
+            // We connect the state to this configuration under the currently checked label
+            TRACE(RCOMP, 3, "Edge " << ci << "-" << addedStateNum << " labeled " << label);
+            edges.add(addedStateNum, {}, label);
         }
-        succp2 = bdd_veccompose(succp2, pair);
+    }
 
-        if (debug == 1) { std::cout << "\nDone creating succphis for state " << statenum << " under label " << label
-                                      << ". Succphi1: " << succp1 << ", succphi2 : " << succp2 << "\n"; }
+    edges.flush(sdba, ci);
 
+    // Add all successors of the new states to the SDBA and connect them
+    for (auto s : added) {
+        addRCompStateSuccs(vwaa, sdba, s, Conf, Rname, phi1, phi2);
+    }
+}
 
 
-        bool accepting = false;
+// Adds successors of state statenum (and their successors, until no new state is found)
+void addRCompStateSuccs(const FlatVWAA &vwaa, spot::twa_graph_ptr &sdba, unsigned statenum,
+                        const BitSet &Conf, std::map<unsigned, BitSet> &Rname,
+                        std::map<unsigned, std::vector<Phi>> &phi1, std::map<unsigned, std::vector<Phi>> &phi2){
 
-        if (succp1 == bdd_true()) {
-            // We make this the breakpoint and change succp1 and succp2 completely
-            if (debug == 1) { std::cout << "Succphi1 is true, making a breakpoint, setting Succphi1 to Succphi2.\n"; }
+    // The states whose successors are still to be added, each state is finished before the next one
+    std::vector<unsigned> todo = { statenum };
+    EdgeAccumulator edges;
 
-            succp1 = succp2;
-            succp1 = subStatesOfRWithTrue(succp1, R);
+    while (!todo.empty()) {
+        statenum = todo.back();
+        todo.pop_back();
 
-            if (debug == 1) { std::cout << "Also changing succphi2 to all states of R.\n"; }
-            succp2 = bdd_false();
-            for (auto qs : R) {
-                if (succp2 == bdd_false()){
-                    succp2 = bdd_ithvar(stoi(qs));
-                } else {
-                    succp2 = bdd_and(succp2, bdd_ithvar(stoi(qs)));
-                }
-            }
-            accepting = true;
-        }
+        TRACE(SUCC, 1, "Successors of state " << statenum << ": R " << Rname[statenum] << ", phi1 " << phi1[statenum]
+                       << ", phi2 " << phi2[statenum]);
 
-        // We finished constructing succphi1 and succphi2, we can start creating the R-component based on them
-        if (debug == 1) {
-            std::cout << "We constructed succphi1: " << succp1 << ", succphi2: " << succp2 << " (under R: ";
-            for (auto x : R) {
-                std::cout << x << ", ";
-            }
-            std::cout << ")\n";
-        }
+        // The R and phis of the state we are adding successors of
+        BitSet R = Rname[statenum];
+        std::vector<Phi> p1 = phi1[statenum];
+        std::vector<Phi> p2 = phi2[statenum];
+        const std::vector<BitSet> &groups = obligationGroups(R);
 
-        // We need to check if this R-component state exists already
-        // succStateNum is the number of the state if it exists, else value remains as a "new state" number:
-        unsigned succStateNum = sdba->num_states();
+        // The phis for the successor state (will reset for each added state)
+        std::vector<Phi> succp1(groups.size());
+        std::vector<Phi> succp2(groups.size());
 
-        bool existsAlready = false;
 
-        // If succp1 is false, we do not add the state/edge, as this branch would never accept anyway
-        if (succp1 != bdd_false()) {
+        // For each class of letters of the alphabet we compute phis of the reached state (succp1 and succp2)
+        for (unsigned lc = 0; lc < gClassLetter.size(); ++lc) {
+            bdd label = gClassLabel[lc];
 
-            if (debug == 1) { std::cout << "\nChecking configurations to find one with same Rname, phi1 and phi2."; }
-            for (unsigned c = 0; c < sdba->num_states(); ++c) {
-                if (Rname[c] == R && phi1[c] == succp1 && phi2[c] == succp2) {
-                    succStateNum = c;
-                    existsAlready = true;
-                    if (debug == 1) { std::cout << " It exists!"; }
-                    break;
+            // The marks of the groups that reach their breakpoint under this class
+            spot::acc_cond::mark_t accepting = {};
+
+            // If some succp1 is false, we do not add the state/edge, as this branch would never accept anyway
+            bool dead = false;
+
+            for (unsigned g = 0; g < groups.size() && !dead; ++g) {
+                // States of succphi1 are replaced with their successors and then states of R with true,
+                // states of succphi2 are only replaced with their successors
+                succp1[g] = succPhi(vwaa, Conf, R, p1[g], lc, true);
+                succp2[g] = succPhi(vwaa, Conf, R, p2[g], lc, false);
+
+                TRACE(SUCC, 3, "Under " << label << " before the breakpoint check of group " << g << ": succphi1 "
+                               << succp1[g] << ", succphi2 " << succp2[g]);
+
+                if (succp1[g].isTrue()) {
+                    // We make this the breakpoint of the group and change its succp1 and succp2 completely
+                    TRACE(SUCC, 2, "Breakpoint of group " << g << " of state " << statenum << " under " << label);
+                    succp1[g] = subStatesOfRWithTrue(succp2[g], R);
+                    succp2[g] = conjunctionOfStates(groups[g]);
+                    accepting.set(g);
                 }
+
+                dead = succp1[g].isFalse();
             }
-            if (debug == 1) { std::cout << "\nOur fitting successor state is state: " << succStateNum << "\n"; }
+
+            if (dead) {
+                continue;
+            }
+
+            // We finished constructing succphi1 and succphi2, we can start creating the R-component based on them
+            TRACE(SUCC, 2, "Under " << label << ": succphi1 " << succp1 << ", succphi2 " << succp2);
+
+            // We need to check if this R-component state exists already
+            // succStateNum is the number of the state if it exists, else value remains as a "new state" number:
+            unsigned succStateNum = gDetIndex.emplace(DetState{ R, succp1, succp2 }, sdba->num_states()).first->second;
 
             // If the state doesn't exist yet, we create it with "sdba->num_states()-1" becoming its new number
-            if (succStateNum == sdba->num_states()) {   // the same as "if !existsAlready"
+            // and add its successors later
+            if (succStateNum == sdba->num_states()) {
                 sdba->new_state();         // succStateNum is now equal to sdba->num_states()-1
                 Rname[succStateNum] = R;
                 phi1[succStateNum] = succp1;
                 phi2[succStateNum] = succp2;
-                //bdd_extvarnum(1);
+                todo.push_back(succStateNum);
+                TRACE(SUCC, 2, "New state " << succStateNum);
+            }
 
-                if (debug == 1) {
-                    std::cout << "This state is new. State num: " << succStateNum << ", R: ";
-                    for (auto x : R) {
-                        std::cout << x << ", ";
-                    }
-                    std::cout << "succp1: " << succp1 << ", succp2: " << succp2 << ", SDBA num states: "
-                              << sdba->num_states() << "\n";
-                    std::cout << "Also creating edge from C" << statenum << " to C"
-                              << succStateNum << " labeled " << label;
-                }
-                if (accepting) {
-                    sdba->new_edge(statenum, succStateNum, label, {0});
-                    if (debug == 1) { std::cout << ", acc {0}. "; }
-                } else {
-                    sdba->new_edge(statenum, succStateNum, label, {});
-                    if (debug == 1) { std::cout << ", acc {}. "; }
-                }
-                if (debug == 1) { std::cout << "\n"; }
-            } else {
-                bool connected = false;
-                if (debug == 1) { std::cout << "This state exists, checking if this edge is new\n"; }
-                // If the state already exists, we check if there is a same-acc edge leading there from the current state
-                for (auto &t: sdba->out(statenum)) {
-                    // If there is such an edge, we add it as OR to the existing edge instead of creating a new edge
-                    if (t.dst == succStateNum && (((t.acc != 0 && accepting) || (t.acc == 0 && !accepting)))) {
-                        if (debug == 1) {
-                            std::cout << "Adding new label to the edge " << t.src << "-" << t.dst
-                                      << " under OR. Adding " << label << " to " << t.cond << ", acc " << t.acc << "\n";
-                        }
-                        connected = true;
-                        t.cond = bdd_or(t.cond, label);
-                    }
-                }
-                // If there isn't such an edge, we create a new one
-                if (!connected) {
-                    if (accepting) {
-                        if (debug == 1) {
-                            std::cout << "There is not an edge " << statenum << "-" << succStateNum
-                                      << " under label " << label << ", acc {0}. Creating it.\n";
-                        }
-                        sdba->new_edge(statenum, succStateNum, label, {0});
-                    } else {
-                        if (debug == 1) {
-                            std::cout << "There is not an edge " << statenum << "-" << succStateNum
-                                      << " under label " << label << ", acc {}. Creating it.\n";
-                        }
-                        sdba->new_edge(statenum, succStateNum, label, {});
-                    }
+            TRACE(SUCC, 3, "Edge " << statenum << "-" << succStateNum << " labeled " << label << ", acc " << accepting);
+            edges.add(succStateNum, accepting, label);
+        }
+
+        edges.flush(sdba, statenum);
+    }
+}
+
+
+void EdgeAccumulator::add(unsigned dst, spot::acc_cond::mark_t acc, bdd label){
+    auto &positions = byDst[dst];
+    for (auto p : positions) {
+        if (edges[p].acc == acc) {
+            edges[p].label = bdd_or(edges[p].label, label);
+            return;
+        }
+    }
+    positions.push_back(edges.size());
+    edges.push_back({ dst, acc, label });
+}
+
+void EdgeAccumulator::flush(spot::twa_graph_ptr &sdba, unsigned src){
+    for (auto &edge : edges) {
+        sdba->new_edge(src, edge.dst, edge.label, edge.acc);
+    }
+    edges.clear();
+    byDst.clear();
+}
+
+
+void minimizeDetPart(spot::twa_graph_ptr &sdba){
+    unsigned ns = sdba->num_states();
+    if (ns < gnc + 2) {
+        return;
+    }
+    unsigned nd = ns - gnc;
+    unsigned ncl = gClassLetter.size();
+
+    // The edges are not merged yet, so the label of each edge is a disjunction of classes of letters
+    // succDst[i * ncl + lc] and succAcc[i * ncl + lc] describe the edge of the state gnc + i under the class lc,
+    // the destination is -1U if there is no such edge
+    std::vector<unsigned> succDst(nd * ncl, -1U);
+    std::vector<spot::acc_cond::mark_t> succAcc(nd * ncl);
+    for (unsigned i = 0; i < nd; ++i) {
+        for (auto &t : sdba->out(gnc + i)) {
+            for (unsigned lc = 0; lc < ncl; ++lc) {
+                if (bdd_implies(gClassLabel[lc], t.cond)) {
+                    succDst[i * ncl + lc] = t.dst;
+                    succAcc[i * ncl + lc] = t.acc;
                 }
             }
+        }
+    }
+
+    // We refine the partition of the deterministic part until it is stable, a state keeps its block
+    // iff it has the same block as before and under each class of letters the same marks and block of the successor
+    typedef std::vector<std::pair<unsigned, spot::acc_cond::mark_t>> Signature;
+    std::vector<unsigned> block(nd, 0);
+    unsigned nblocks = 1;
+    while (true) {
+        std::map<Signature, unsigned> blockOf;
+        std::vector<unsigned> newBlock(nd);
+        Signature sig;
+        for (unsigned i = 0; i < nd; ++i) {
+            sig.clear();
+            sig.emplace_back(block[i], spot::acc_cond::mark_t{});
+            for (unsigned lc = 0; lc < ncl; ++lc) {
+                unsigned dst = succDst[i * ncl + lc];
+                sig.emplace_back(dst == -1U ? -1U : block[dst - gnc], succAcc[i * ncl + lc]);
+            }
+            newBlock[i] = blockOf.emplace(sig, blockOf.size()).first->second;
+        }
+        block.swap(newBlock);
+        if (blockOf.size() == nblocks) {
+            break;
+        }
+        nblocks = blockOf.size();
+    }
+
+    TRACE(SUCC, 1, "Minimization of the deterministic part: " << nd << " states, " << nblocks << " blocks");
+    if (nblocks == nd) {
+        return;
+    }
+
+    // The first state of each block represents it, all edges (also the ones from the nondeterministic part)
+    // are redirected to the representatives and the other states become unreachable
+    std::vector<unsigned> rep(nblocks, -1U);
+    for (unsigned i = 0; i < nd; ++i) {
+        if (rep[block[i]] == -1U) {
+            rep[block[i]] = gnc + i;
+        }
+    }
+    for (auto &t : sdba->edges()) {
+        if (t.dst >= gnc) {
+            t.dst = rep[block[t.dst - gnc]];
+        }
+    }
 
-            // If the state is new and phi1 is not false, add all further successors of this state to SDBA and connect them
-            if (!existsAlready) {
-                if (succp1 != bdd_false()) {
-                    if (debug == 1) { std::cout << "This state is new and its Phi1 != false, we are adding its succs.\n"; }
-                    addRCompStateSuccs(vwaa, sdba, succStateNum, Conf, Rname, phi1, phi2);
+    // The states of the nondeterministic part are all reachable and keep their numbers,
+    // the edges redirected to the same representative are joined
+    sdba->purge_unreachable_states();
+    sdba->merge_edges();
+}
+
+const std::vector<BitSet> &obligationGroups(const BitSet &R){
+    auto it = gRGroups.find(R);
+    if (it != gRGroups.end()) {
+        return it->second;
+    }
+
+    std::vector<BitSet> groups;
+    if (!o_gen_buchi || R.empty()) {
+        groups.push_back(R);
+    } else {
+        // reached[g] are the states reachable from the group g, the groups reaching a common state are joined
+        std::vector<BitSet> reached;
+        for (auto q : R.elements()) {
+            BitSet group(gnvwaa);
+            group.insert(q);
+            BitSet reach = gClosure[q];
+            for (unsigned g = 0; g < groups.size();) {
+                if (reached[g].intersects(reach)) {
+                    group |= groups[g];
+                    reach |= reached[g];
+                    groups.erase(groups.begin() + g);
+                    reached.erase(reached.begin() + g);
                 } else {
-                    if (debug == 1) { std::cout << "Phi1 (" << succp1 << ") of this state is false, so we do not add succs. \n"; }
+                    ++g;
                 }
-            } else {
-                if (debug == 1) { std::cout << "This state already exists, not adding its succs. \n"; }
             }
+            groups.push_back(group);
+            reached.push_back(reach);
+        }
+    }
+
+    TRACE(RCOMP, 2, "R " << R << " has " << groups.size() << " obligation group(s)");
+    return gRGroups.emplace(R, groups).first->second;
+}
+
+Phi conjunctionOfStates(const BitSet &states){
+    // An empty set gives false, as an R-component without R never accepts
+    Phi result;
+    if (o_antichains) {
+        if (!states.empty()) {
+            result.sets = Antichain(states);
+        }
+        return result;
+    }
+
+    result.b = bdd_false();
+    for (auto q : states.elements()) {
+        if (result.b == bdd_false()){
+            result.b = bdd_ithvar(gStateVar[q]);
         } else {
-            if (debug == 1) { std::cout << "\nPhi1 is false, not adding this succstate.\n"; }
+            result.b = bdd_and(result.b, bdd_ithvar(gStateVar[q]));
         }
+    }
+    return result;
+}
 
+
+std::vector<int> orderStateVars(const spot::twa_graph_ptr &vwaa, int base){
+    std::vector<int> var(gnvwaa, -1);
+    int next = base;
+
+    // The states get their variables in the breadth-first order from the initial states, placing
+    // the destinations of each edge next to each other; in a very weak automaton, this puts each state
+    // after one of its predecessors and the states occurring together in configurations close together
+    std::queue<unsigned> queue;
+    auto place = [&](unsigned q) {
+        if (var[q] == -1) {
+            var[q] = next++;
+            queue.push(q);
+        }
+    };
+    for (unsigned q : vwaa->univ_dests(vwaa->get_init_state_number())) {
+        place(q);
     }
-    if (debug == 1) { std::cout << "\n<<<<<<   End of function addRCompStateSuccs of state " << statenum << "\n"; }
+    while (!queue.empty()) {
+        unsigned q = queue.front();
+        queue.pop();
+        for (auto &t : vwaa->out(q)) {
+            for (unsigned d : vwaa->univ_dests(t.dst)) {
+                place(d);
+            }
+        }
+    }
+
+    // The unreachable states (there should be none) get the remaining variables
+    for (unsigned q = 0; q < gnvwaa; ++q) {
+        if (var[q] == -1) {
+            var[q] = next++;
+        }
+    }
+
+    return var;
 }
 
+void addGuardLetters(bdd guard, unsigned digit, unsigned naps, unsigned li, BitSet &letters){
+    // Letter li has the atomic proposition number digit iff its bit number digit is set, as in gAlphabet
+    if (guard == bdd_false()) {
+        return;
+    }
+    if (digit == naps) {
+        letters.insert(li);
+        return;
+    }
 
-// Gets the bdd of successors of q under label belonging to m.t. relation
-bdd getqSuccs(std::shared_ptr<spot::twa_graph> vwaa, std::set<std::string> Conf, std::set<std::string> R, unsigned q,
-              bdd label){
+    if (guard != bdd_true() && bdd_var(guard) == gApVar[digit]) {
+        addGuardLetters(bdd_high(guard), digit + 1, naps, li | (1U << digit), letters);
+        addGuardLetters(bdd_low(guard), digit + 1, naps, li, letters);
+    } else {
+        // The guard does not depend on this proposition
+        addGuardLetters(guard, digit + 1, naps, li | (1U << digit), letters);
+        addGuardLetters(guard, digit + 1, naps, li, letters);
+    }
+}
 
-    if (debug == 1) { std::cout << "\nGetting succs of state " << q << " under label " << label << "\n"; }
+bool edgeEnabled(const FlatVWAA &vwaa, unsigned e, unsigned li){
+    if (!vwaa.letters.empty()) {
+        return vwaa.letters[e].contains(li);
+    }
+    return bdd_implies(gAlphabet[li], vwaa.guard[e]);
+}
+
+bdd succPhi(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, bdd phi, unsigned lc, bool substituteR){
+    // R is a subset of Conf, so the successors do not depend on the rest of Conf
+    auto rit = gRIds.find(R);
+    if (rit == gRIds.end()) {
+        rit = gRIds.emplace(R, gRIds.size()).first;
+    }
+    SuccKey key = { rit->second, phi.id(), lc, substituteR };
+
+    ++gSuccLookups;
+    auto it = gSuccCache.find(key);
+    if (it != gSuccCache.end()) {
+        ++gSuccHits;
+        return it->second.succ;
+    }
+
+    unsigned li = gClassLetter[lc];
+    bddPair* pair = bdd_newpair();
+    for (unsigned q = 0; q < gnvwaa; q++){
+        // For each state q in phi
+        // "if (bdd_implies(phi, bdd_ithvar(q)))" is not enough if phi contains disjunctions, so we use handlers
+        gImplies = false;
+        gLabel = gStateVar[q];
+        bdd_allsat(phi, allSatImpliesHandler);
+        if (gImplies){
+            bdd_setbddpair(pair, gStateVar[q], getqSuccs(vwaa, Conf, R, q, li));
+        }
+    }
+    // Replace all first parts of pairs with the second (replacing all q-s with their successors)
+    bdd succ = bdd_veccompose(phi, pair);
+    bdd_freepair(pair);
+
+    if (substituteR) {
+        succ = subStatesOfRWithTrue(succ, R);
+    }
+
+    // The entry keeps phi alive, so that its id is not reused by another BDD
+    gSuccCache[key] = { phi, succ };
+    return succ;
+}
+
+// With -A, the successor of phi is built from the antichains of the successors of its states, it is not cached
+Phi succPhi(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, const Phi &phi, unsigned lc, bool substituteR){
+    Phi result;
+    if (!o_antichains) {
+        result.b = succPhi(vwaa, Conf, R, phi.b, lc, substituteR);
+        return result;
+    }
+
+    // Each set of phi is a conjunction of states, so its successor is the product of the successors of its states
+    unsigned li = gClassLetter[lc];
+    for (auto &set : phi.sets.get_sets()) {
+        Antichain conj = Antichain(BitSet(gnvwaa));
+        for (auto q : set.elements()) {
+            conj = conj & getqSuccSets(vwaa, Conf, R, q, li);
+            if (conj.is_false()) {
+                break;
+            }
+        }
+        result.sets = result.sets | conj;
+    }
+
+    if (substituteR) {
+        result = subStatesOfRWithTrue(result, R);
+    }
+    return result;
+}
+
+Phi qSuccs(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, unsigned q, unsigned li){
+    Phi result;
+    if (o_antichains) {
+        result.sets = getqSuccSets(vwaa, Conf, R, q, li);
+    } else {
+        result.b = getqSuccs(vwaa, Conf, R, q, li);
+    }
+    return result;
+}
+
+Antichain getqSuccSets(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, unsigned q, unsigned li){
+
+    Antichain succs;
+
+    // The same m.t. as in getqSuccs, each enabled edge gives one set of destinations
+    bool inR = R.contains(q);
+    if (!inR || Conf.contains(q)) {
+        for (unsigned e = vwaa.edgeBegin[q]; e < vwaa.edgeBegin[q + 1]; ++e) {
+            if (edgeEnabled(vwaa, e, li) && !(inR && vwaa.accepting[e])) {
+                succs = succs | Antichain(vwaa.dests[e]);
+            }
+        }
+    }
+
+    TRACE(MT, 3, "Successors of " << q << " under " << gAlphabet[li] << (inR ? " (in R)" : "") << ": " << succs);
+    return succs;
+}
+
+// Gets the bdd of successors of q under letter li belonging to m.t. relation
+bdd getqSuccs(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, unsigned q, unsigned li){
 
     bdd succbdd = bdd_false();
-    bdd edgebdd = bdd_false();
 
-    bool edgeEmpty;
+    // For the transition to be a correct m.t., q either needs to not be in R,
+    // or q must be in Conf and the edge must not be accepting
+    bool inR = R.contains(q);
+    if (!inR || Conf.contains(q)) {
+        for (unsigned e = vwaa.edgeBegin[q]; e < vwaa.edgeBegin[q + 1]; ++e) {
+            if (edgeEnabled(vwaa, e, li) && !(inR && vwaa.accepting[e])) {
+                // We connect the destinations of this edge to the bdd under OR
+                succbdd = bdd_or(succbdd, vwaa.destBdd[e]);
+            }
+        }
+    }
 
-    // If edge under label is a correct m.t., add its follower to succbdd
+    TRACE(MT, 3, "Successors of " << q << " under " << gAlphabet[li] << (inR ? " (in R)" : "") << ": " << succbdd);
+    return succbdd;
+}
+
+FlatVWAA flattenVWAA(const spot::twa_graph_ptr &vwaa){
+    FlatVWAA result;
+    unsigned naps = vwaa->ap().size();
 
-    // For the transition to be a correct m.t., q either needs to not be in R, or see below *
-    if ((R.find(std::to_string(q)) == R.end())) {
-        if (debug == 1) { std::cout << "Q is not in R."; }
-        // Find the edge under "label"
+    for (unsigned q = 0; q < gnvwaa; ++q) {
+        result.edgeBegin.push_back(result.guard.size());
         for (auto &t: vwaa->out(q)) {
-            if (debug == 1) { std::cout << "\nEdge from " << t.src; }
-            edgebdd = bdd_false();
-            bool edgeEmpty = true;
-            // For each destination of an alternating edge, we connect the correct destinations under AND
-            for (unsigned tdst: vwaa->univ_dests(t.dst)) {
-                if (debug == 1) {
-                    std::cout << "\nEdge " << t.src << "-" << tdst << " t.cond: " << t.cond << ", label: " << label << ". \n";
+            BitSet dests(gnvwaa);
+            bdd destBdd = bdd_true();
+            bool loop = false;
+            // The state t accepts everything, so it is folded into the destinations as true
+            for (unsigned d: vwaa->univ_dests(t.dst)) {
+                if (d == q) {
+                    loop = true;
                 }
-                if (bdd_implies(label, t.cond) && (tdst < gnvwaa)) {
-                    if (debug == 1) { std::cout << "<- the label is right. "; }
-
-                    // Add this successor of q
-                    // If this state is {}, add bdd_true instead
-
-                    if (edgebdd == bdd_false()){
-                        // If the bdd is false, we only add if it's empty
-                        if (edgeEmpty){
-                            edgeEmpty = false;
-                            if (tdst == gtnum){
-                                if (debug == 1) { std::cout << "This is the {} state, creating edgebdd as true"; }
-                                edgebdd = bdd_true();
-                            } else {
-                                if (debug == 1) { std::cout << "Creating edgebdd as tdst (" << tdst << ")"; }
-                                edgebdd = bdd_ithvar(tdst);
-                            }
-                        }
-                    } else {
-                        if (tdst == gtnum){
-                            if (debug == 1) { std::cout << "This is the {} state, adding true to edgebdd"; }
-                            edgebdd = bdd_true();
-                        } else {
-                            if (debug == 1) { std::cout << "Adding tdst (" << tdst << ") to edgebdd"; }
-                            edgebdd = bdd_and(edgebdd, bdd_ithvar(tdst));
-                        }
-                    }
+                if (d != gtnum) {
+                    dests.insert(d);
+                    destBdd = bdd_and(destBdd, bdd_ithvar(gStateVar[d]));
                 }
             }
 
-            if (debug == 1) { std::cout << "\nAdding edgebdd " << edgebdd << " to succbdd " << succbdd << " under OR"; }
-            // We connect the destinations of this edge to the bdd under OR
-            succbdd = bdd_or(succbdd, edgebdd);
-            if (debug == 1) { std::cout << "\nGetting succbdd " << succbdd << "\n"; }
+            result.guard.push_back(t.cond);
+            result.dests.push_back(dests);
+            result.destBdd.push_back(destBdd);
+            result.accepting.push_back(bool(t.acc));
+            result.loop.push_back(loop);
+
+            // For small alphabets, we store the guard of each edge as the set of letters enabling it,
+            // so that checking a letter is a bit test and intersecting guards is an AND of words
+            if (naps <= gMaxTableAps) {
+                BitSet letters(gAlphabet.size());
+                addGuardLetters(t.cond, 0, naps, 0, letters);
+                result.letters.push_back(letters);
+            }
         }
-    } else { // * or q must be in Conf && edge must not be accepting
-        if (debug == 1) { std::cout << "Q is in R."; }
-        if (Conf.find(std::to_string(q)) != Conf.end()) {
-            if (debug == 1) { std::cout << "\nQ is in Conf."; }
-            // Find the edge under "label"
-            for (auto &t: vwaa->out(q)) {
-                if (debug == 1) {
-                    std::cout << "\nEdge from " << t.src;
-                }
-                edgebdd = bdd_false();
-                edgeEmpty = true;
-                for (unsigned tdst: vwaa->univ_dests(t.dst)) {
-                    if (debug == 1) {
-                        std::cout << "\n Edge " << t.src << "-" << tdst << " t.cond: " << t.cond << ", label: " << label << ".";
-                    }
-                    if (bdd_implies(label, t.cond) && (tdst < gnvwaa)) {
-                        if (debug == 1) { std::cout << "\n  <- the label is right "; }
-
-                        if (t.acc == 0) {
-                            if (debug == 1) { std::cout << "and it is not accepting. "; }
-
-                            if (edgebdd == bdd_false()){
-                                // If the bdd is false, we only add if it's empty
-                                if (edgeEmpty) {
-                                    edgeEmpty = false;
-                                    if (tdst == gtnum) {
-                                        if (debug == 1) {
-                                            std::cout << "This is the {} state, creating edgebdd as true";
-                                        }
-                                        edgebdd = bdd_true();
-                                    } else {
-                                        if (debug == 1) { std::cout << "Creating edgebdd as tdst (" << tdst << ")"; }
-                                        edgebdd = bdd_ithvar(tdst);
-                                    }
-                                }
-                            } else {
-                                if (tdst == gtnum){
-                                    if (debug == 1) { std::cout << "This is the {} state, adding true to edgebdd"; }
-                                    edgebdd = bdd_true();
-                                } else {
-                                    if (debug == 1) { std::cout << "Adding tdst (" << tdst << ") to edgebdd"; }
-                                    edgebdd = bdd_and(edgebdd, bdd_ithvar(tdst));
-                                }
-                            }
-                        }
-                    }
-                }
+    }
+    result.edgeBegin.push_back(result.guard.size());
 
-                // We connect the destinations of this edge to the bdd under OR
-                if (debug == 1) { std::cout << "\nAdding edgebdd " << edgebdd << " to succbdd " << succbdd << " under OR"; }
-                succbdd = bdd_or(succbdd, edgebdd);
-                if (debug == 1) { std::cout << "\nGetting succbdd " << succbdd << "\n"; }
-            }
+    result.init = BitSet(gnvwaa);
+    for (unsigned d: vwaa->univ_dests(vwaa->get_init_state_number())) {
+        if (d != gtnum) {
+            result.init.insert(d);
         }
     }
-    if (debug == 1) { std::cout << "\nAdded all succs of " << q << " under " << label << ", got: " << succbdd << "\n"; }
 
-    return succbdd;
+    return result;
+}
+
+Phi subStatesOfRWithTrue(const Phi &phi, const BitSet &R){
+    Phi result;
+    if (o_antichains) {
+        // Like for the BDDs, only the states of R implied by phi (those in all its sets) are replaced with true
+        result.sets = phi.sets.without(phi.sets.implied(gnvwaa) & R);
+    } else {
+        result.b = subStatesOfRWithTrue(phi.b, R);
+    }
+    return result;
+}
+
+Phi Phi::truth(){
+    Phi result;
+    if (o_antichains) {
+        result.sets = Antichain(BitSet(gnvwaa));
+    } else {
+        result.b = bdd_true();
+    }
+    return result;
+}
+
+bool Phi::isTrue() const {
+    return o_antichains ? sets.is_true() : b == bdd_true();
 }
 
-bdd subStatesOfRWithTrue(bdd phi, std::set<std::string> R){
+bool Phi::isFalse() const {
+    return o_antichains ? sets.is_false() : b == bdd_false();
+}
 
-    if (debug == 1) { std::cout << "\nReplacing all states of R with true in " << phi; }
+Phi Phi::operator&(const Phi &other) const {
+    Phi result;
+    if (o_antichains) {
+        result.sets = sets & other.sets;
+    } else {
+        result.b = bdd_and(b, other.b);
+    }
+    return result;
+}
+
+size_t DetStateHash::operator()(const DetState &state) const {
+    size_t h = state.R.hash();
+    for (auto &phi : state.phi1) {
+        h ^= phi.hash() + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    for (auto &phi : state.phi2) {
+        h ^= phi.hash() + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
+bdd subStatesOfRWithTrue(bdd phi, const BitSet &R){
 
     // If this phi is false, we return false or we'd get weird results (as implication from false is true)
     if (phi != bdd_false()) {
         // For all states of Q, find those that are in Phi
-        if (debug == 1) { std::cout << "\nChecking q-s"; }
         for (unsigned q = 0; q < gnvwaa; q++) {
-            if (debug == 1) { std::cout << ". " << q; }
-
-            if (bdd_implies(phi, bdd_ithvar(q))) {
-                if (debug == 1) { std::cout << " - it's in " << phi; }
-
-                if ((R.find(std::to_string(q)) != R.end())) {
-                    if (debug == 1) { std::cout << ".\n It's in R. Recomposing it as true"; }
+            if (bdd_implies(phi, bdd_ithvar(gStateVar[q]))) {
+                if (R.contains(q)) {
                     // Replace q with true
-                    phi = bdd_compose(phi, bdd_true(), q);
+                    phi = bdd_compose(phi, bdd_true(), gStateVar[q]);
                 }
             }
         }
     }
-    if (debug == 1) { std::cout << "\n"; }
     return phi;
 }
\ No newline at end of file
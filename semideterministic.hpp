@@ -25,7 +25,7 @@
 #include <spot/twaalgos/postproc.hh>
 #include <spot/twaalgos/simulation.hh>
 #include <spot/twaalgos/sccfilter.hh>
-#include <spot/twaalgos/alternation.hh>
+#include <spot/twaalgos/sccinfo.hh>
 #include <spot/parseaut/public.hh>
 #include <spot/twaalgos/reachiter.hh>
 #include <spot/twa/bddprint.hh>
@@ -33,52 +33,226 @@
 #include <sstream>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include "antichain.hpp"
 #include "automaton.hpp"
+#include "bitset.hpp"
+#include "trace.hpp"
+
+
+// the parsed VWAA flattened into arrays for the loops of the construction,
+// the edges of the state q are numbered edgeBegin[q], ..., edgeBegin[q + 1] - 1
+struct FlatVWAA {
+    std::vector<unsigned> edgeBegin;
+    std::vector<bdd> guard;         // labels of the edges
+    std::vector<BitSet> letters;    // letters of gAlphabet enabling the edges, empty above gMaxTableAps
+    std::vector<BitSet> dests;      // destinations of the edges without the state t
+    std::vector<bdd> destBdd;       // conjunctions of the destinations, t is true
+    std::vector<char> accepting;    // whether the edges have a mark
+    std::vector<char> loop;         // whether the edges lead back to their source
+    BitSet init;                    // the initial configuration without the state t
+};
+
+
+// key of the cache of successor phis: number of R, id of the phi BDD, class of letters
+// and whether states of R are replaced with true
+struct SuccKey {
+    unsigned r;
+    int phi;
+    unsigned letterClass;
+    bool substituteR;
+
+    bool operator==(const SuccKey &other) const {
+        return r == other.r && phi == other.phi && letterClass == other.letterClass && substituteR == other.substituteR;
+    }
+};
+
+struct SuccKeyHash {
+    size_t operator()(const SuccKey &key) const {
+        return ((size_t) key.r * 0x9e3779b97f4a7c15ULL) ^ ((size_t) key.phi << 17) ^ (key.letterClass << 1) ^ key.substituteR;
+    }
+};
+
+struct SuccValue {
+    bdd phi;
+    bdd succ;
+};
+
+
+// a phi of a state of the deterministic part, a positive Boolean formula over the states of the VWAA:
+// a BDD, or with -A the antichain of its minimal configurations; the unused member stays false
+struct Phi {
+    bdd b;
+    Antichain sets;
+
+    static Phi truth();
+    bool isTrue() const;
+    bool isFalse() const;
+    Phi operator&(const Phi &other) const;
+
+    bool operator==(const Phi &other) const {
+        return b == other.b && sets == other.sets;
+    }
+
+    size_t hash() const {
+        return o_antichains ? sets.hash() : (size_t) b.id();
+    }
+};
+
+
+// a state of the deterministic part: R and the phis of each of its obligation groups
+struct DetState {
+    BitSet R;
+    std::vector<Phi> phi1;
+    std::vector<Phi> phi2;
+
+    bool operator==(const DetState &other) const {
+        return R == other.R && phi1 == other.phi1 && phi2 == other.phi2;
+    }
+};
+
+struct DetStateHash {
+    size_t operator()(const DetState &state) const;
+};
+
+
+// collects the edges leaving one state of the SDBA: labels of the edges with the same destination
+// and marks are joined, the edges are added to the automaton by flush once the state is finished
+struct EdgeAccumulator {
+    struct PendingEdge {
+        unsigned dst;
+        spot::acc_cond::mark_t acc;
+        bdd label;
+    };
+    std::vector<PendingEdge> edges;
+    std::unordered_map<unsigned, std::vector<unsigned>> byDst; // positions in edges for each destination
+
+    void add(unsigned dst, spot::acc_cond::mark_t acc, bdd label);
+    void flush(spot::twa_graph_ptr &sdba, unsigned src);
+};
 
 
 // turns the given VWAA into an equivalent semideterministic
-// automaton in the Spot's structure
-spot::twa_graph_ptr make_semideterministic(VWAA *vwaa, unsigned debug);
+// automaton in the Spot's structure; the named property "deterministic-part" (unsigned) is the first
+// state of the deterministic part, the states before it form the nondeterministic part
+spot::twa_graph_ptr make_semideterministic(VWAA *vwaa);
 
 
-// Conf = States Q we need to check
-// Valid = States marked as QMay or their successors
-// checks whether the set of states Conf of vwaa contains only states that are qmay or are reachable from them
-bool checkMayReachableStates(std::shared_ptr<spot::twa_graph> vwaa, std::set<std::string> Conf,
-                             std::set<std::string> Valid, bool isqmay[]);
+// sets the properties of the finished sdba whose deterministic part starts at the state detPart: semi-determinism,
+// the deterministic part and what is known of determinism, completeness and weakness (computed from the SCCs)
+void setProperties(spot::twa_graph_ptr &sdba, unsigned detPart);
 
 
-// adds the state q and its successors to the set of valid states for R set
-void addToValid(std::shared_ptr<spot::twa_graph> vwaa, std::string q, std::set<std::string> &Valid);
+// builds the deterministic automaton whose states are the phis of the VWAA (with every edge, no R),
+// for a VWAA without marks (safety, every edge is accepting) or where only t loops without a mark
+// (guarantee, the edges of the state true are accepting); the automaton is weak and semideterministic
+void makeWeakDeterministic(const FlatVWAA &vwaa, bool safety, spot::twa_graph_ptr &sdba);
+
+
+// removes alternation of the very weak automaton vwaa by a subset construction
+// that explores only reachable configurations; configurations are stored in C as sets of
+// VWAA states (the empty configuration is {t}), valid tells whether the configuration passes
+// the Qmay filter of checkMayReachableStates, the acceptance is not tracked at all;
+// the configurations are added as states of sdba
+void removeAlternation(const FlatVWAA &vwaa, const std::vector<BitSet> &closure, bool isqmay[],
+                       spot::twa_graph_ptr &sdba, std::vector<BitSet> &C, std::vector<bool> &valid);
+
+
+// confs are pairs of a configuration and the set of letters leading to it
+// joins equal configurations and removes from each configuration the letters of its proper subsets
+void minimizeConfs(std::vector<std::pair<BitSet, BitSet>> &confs);
+
+
+// returns for each state q of vwaa the set of q and all states reachable from q (except the state t)
+std::vector<BitSet> computeReachClosures(const FlatVWAA &vwaa);
+
+
+// Conf = States Q we need to check
+// closure = States reachable from each state, as computed by computeReachClosures
+// checks whether the set of states Conf of vwaa contains only states that are qmay or are reachable from them
+bool checkMayReachableStates(const BitSet &Conf, const std::vector<BitSet> &closure, bool isqmay[]);
 
 
 // Conf = The configuration C we are creating R for
 // remaining = States Q (of the configuration C) that we still need to check
 // Goes through all states of Conf, checks if they are qmay and qmust, adds corresponding states of VWAA into R
-void createDetPart(std::shared_ptr<spot::twa_graph> vwaa, unsigned ci, std::set<std::string> Conf,
-             std::set<std::string> remaining, std::set<std::string> R,  bool isqmay[], bool isqmust[],
-             spot::twa_graph_ptr &sdba, std::map<unsigned, std::set<std::string>> &Rname,
-             std::map<unsigned, bdd> &phi1, std::map<unsigned, bdd> &phi2);
+void createDetPart(const FlatVWAA &vwaa, unsigned ci, const BitSet &Conf, BitSet remaining, BitSet R,
+                   bool isqmay[], bool isqmust[], spot::twa_graph_ptr &sdba, std::map<unsigned, BitSet> &Rname,
+                   std::map<unsigned, std::vector<Phi>> &phi1, std::map<unsigned, std::vector<Phi>> &phi2);
+
+
+// creates r-components from a given R, phi1 and phi2 of a state have one entry for each obligation group of R
+void createRComp(const FlatVWAA &vwaa, unsigned ci, const BitSet &Conf, const BitSet &R,
+                 spot::twa_graph_ptr &sdba, std::map<unsigned, BitSet> &Rname,
+                 std::map<unsigned, std::vector<Phi>> &phi1, std::map<unsigned, std::vector<Phi>> &phi2);
+
+
+// adds r-component states that are successors of a given (R, phi1, phi2), and their successors
+// using a worklist; the edges of each state are added at once when the state is finished
+void addRCompStateSuccs(const FlatVWAA &vwaa, spot::twa_graph_ptr &sdba, unsigned statenum,
+                        const BitSet &Conf, std::map<unsigned, BitSet> &Rname,
+                        std::map<unsigned, std::vector<Phi>> &phi1, std::map<unsigned, std::vector<Phi>> &phi2);
+
+
+// merges equivalent states of the deterministic part (states gnc and higher) by partition refinement,
+// states are equivalent if under each class of letters they have edges with the same marks to equivalent states;
+// the edges leading to the merged states are joined afterwards
+void minimizeDetPart(spot::twa_graph_ptr &sdba);
+
+
+// splits R into obligation groups, each with its own breakpoint and acceptance mark: with -g, the states of R
+// reaching a common state (by gClosure) are in the same group, otherwise (or for an empty R) there is just R;
+// the results are cached in gRGroups
+const std::vector<BitSet> &obligationGroups(const BitSet &R);
+
+
+// gets the conjunction of the given states, false for no states
+Phi conjunctionOfStates(const BitSet &states);
+
 
+// gets the successor of phi under the class of letters lc: each state of phi is replaced with its successors
+// (see getqSuccs) and then, if substituteR is set, each state of R with true; the results are cached in gSuccCache
+bdd succPhi(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, bdd phi, unsigned lc, bool substituteR);
 
-// creates r-components from a given R
-void createRComp(std::shared_ptr<spot::twa_graph> vwaa, unsigned ci, std::set<std::string> Conf,
-                 std::set<std::string> R, spot::twa_graph_ptr &sdba, std::map<unsigned, std::set<std::string>> &Rname,
-                 std::map<unsigned, bdd> &phi1, std::map<unsigned, bdd> &phi2);
 
+// the same for either representation of phi, antichains are not cached
+Phi succPhi(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, const Phi &phi, unsigned lc, bool substituteR);
 
-// adds r-component states that are successors of a given (R, phi1, phi2)
-void addRCompStateSuccs(std::shared_ptr<spot::twa_graph> vwaa, spot::twa_graph_ptr &sdba,  unsigned statenum,
-                        std::set<std::string> Conf, std::map<unsigned, std::set<std::string>> &Rname,
-                        std::map<unsigned, bdd> &phi1, std::map<unsigned, bdd> &phi2);
 
+// gets the successors of q under the letter number li in the representation of phis, see getqSuccs
+Phi qSuccs(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, unsigned q, unsigned li);
 
-// gets the bdd of successors of q under label belonging to modified transition (m.t.) relation
-bdd getqSuccs(std::shared_ptr<spot::twa_graph> vwaa, std::set<std::string> Conf, std::set<std::string> R, unsigned q,
-              bdd label);
+
+// gets the successors of q under the letter number li as the antichain of sets of states, see getqSuccs
+Antichain getqSuccSets(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, unsigned q, unsigned li);
+
+
+// gets the bdd of successors of q under the letter number li belonging to modified transition (m.t.) relation
+bdd getqSuccs(const FlatVWAA &vwaa, const BitSet &Conf, const BitSet &R, unsigned q, unsigned li);
+
+
+// assigns the BDD variables base, base + 1, ... to the states of vwaa (see the definition for the order)
+std::vector<int> orderStateVars(const spot::twa_graph_ptr &vwaa, int base);
+
+
+// adds to letters all letters of gAlphabet satisfying guard, digit is the first atomic proposition
+// not yet decided and li has the bits of the decided ones (the first call is with digit = li = 0)
+void addGuardLetters(bdd guard, unsigned digit, unsigned naps, unsigned li, BitSet &letters);
+
+
+// checks whether the letter number li of gAlphabet enables the edge e of vwaa
+bool edgeEnabled(const FlatVWAA &vwaa, unsigned e, unsigned li);
+
+
+// flattens the parsed vwaa, gtnum and gAlphabet must already be set
+FlatVWAA flattenVWAA(const spot::twa_graph_ptr &vwaa);
 
 
 // gets the bdd of phi with all states in R replaced by true
-bdd subStatesOfRWithTrue(bdd phi, std::set<std::string> R);
+bdd subStatesOfRWithTrue(bdd phi, const BitSet &R);
+
+
+// the same for either representation of phi
+Phi subStatesOfRWithTrue(const Phi &phi, const BitSet &R);
 
 #endif
\ No newline at end of file
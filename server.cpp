@@ -0,0 +1,204 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "utils.hpp"
+#include "server.hpp"
+
+// the listening socket is handed over to the recycled server in this environment variable
+static const char* server_fd_env = "LTL2SDBA_SERVER_FD";
+
+// a client has this long to send its whole request, so that an idle one does not stall the others
+static const int request_timeout_ms = 10000;
+
+int run_server(std::string socket_path, unsigned max_requests, char* argv[], translate_function translate) {
+	// a client closing its connection early must not kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	int server_fd;
+	const char* inherited_fd = getenv(server_fd_env);
+
+	if (inherited_fd != nullptr) {
+		// we are a recycled server, the socket is already listening
+		server_fd = std::atoi(inherited_fd);
+	} else {
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+
+		if (socket_path.size() >= sizeof(addr.sun_path)) {
+			std::cerr << "The socket path is too long.\n";
+			return 1;
+		}
+		strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+		server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (server_fd < 0) {
+			std::cerr << "Unable to create the socket: " << strerror(errno) << '\n';
+			return 1;
+		}
+
+		// remove a stale socket of a previous server
+		unlink(socket_path.c_str());
+
+		if (bind(server_fd, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(server_fd, SOMAXCONN) < 0) {
+			std::cerr << "Unable to listen on " << socket_path << ": " << strerror(errno) << '\n';
+			close(server_fd);
+			return 1;
+		}
+	}
+
+	for (unsigned served = 0; max_requests == 0 || served < max_requests; ++served) {
+		int client_fd = accept(server_fd, nullptr, nullptr);
+		if (client_fd < 0) {
+			if (errno == EINTR) {
+				--served;
+				continue;
+			}
+			int error = errno;
+			std::cerr << "Unable to accept a connection: " << strerror(error) << '\n';
+
+			// a client gone before the accept or a lack of descriptors or buffers passes, the server goes on
+			if (error == ECONNABORTED || error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM) {
+				if (error == EMFILE || error == ENFILE) {
+					usleep(100000);
+				}
+				--served;
+				continue;
+			}
+			return 1;
+		}
+
+		std::vector<std::string> request;
+		if (!read_request(client_fd, request)) {
+			close(client_fd);
+			continue;
+		}
+
+		// parse the request exactly as the command line
+		std::vector<char*> request_argv = { argv[0] };
+		for (auto& arg : request) {
+			request_argv.push_back(&arg[0]);
+		}
+		auto args = parse_arguments(request_argv.size(), request_argv.data());
+
+		int status = 1;
+		std::stringstream output;
+
+		if (args.count("f") == 0) {
+			output << "The request has to contain valid options and a formula (-f).\n";
+		} else if (args.count("S") > 0 || args["m"] != "0") {
+			output << "The options -S and -m are not available in requests.\n";
+		} else {
+			// redirect all output of the translation into the response
+			std::streambuf* coutbuf = std::cout.rdbuf(output.rdbuf());
+			std::streambuf* cerrbuf = std::cerr.rdbuf(output.rdbuf());
+
+			try {
+				status = translate(args);
+			} catch (...) {
+				std::cout << "The translation failed.\n";
+			}
+
+			std::cout.rdbuf(coutbuf);
+			std::cerr.rdbuf(cerrbuf);
+		}
+
+		write_response(client_fd, std::to_string(status) + '\n' + output.str());
+		close(client_fd);
+	}
+
+	// replace this process by a fresh one, keeping the listening socket open
+	setenv(server_fd_env, std::to_string(server_fd).c_str(), 1);
+	execv("/proc/self/exe", argv);
+	execvp(argv[0], argv);
+
+	std::cerr << "Unable to restart the server: " << strerror(errno) << '\n';
+	return 1;
+}
+
+bool read_request(int fd, std::vector<std::string>& args) {
+	std::string data;
+	char buffer[4096];
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(request_timeout_ms);
+
+	// read until an empty line or the end of the stream
+	while (data.find("\n\n") == std::string::npos) {
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		pollfd pfd = { fd, POLLIN, 0 };
+		int ready = remaining.count() > 0 ? poll(&pfd, 1, remaining.count()) : 0;
+		if (ready < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ready <= 0) {
+			return false;
+		}
+
+		ssize_t count = read(fd, buffer, sizeof(buffer));
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (count == 0) {
+			break;
+		}
+		data.append(buffer, count);
+	}
+
+	std::istringstream lines(data.substr(0, data.find("\n\n")));
+	std::string line;
+	while (std::getline(lines, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (!line.empty()) {
+			args.push_back(line);
+		}
+	}
+
+	return true;
+}
+
+void write_response(int fd, const std::string& response) {
+	size_t written = 0;
+	while (written < response.size()) {
+		ssize_t count = write(fd, response.data() + written, response.size() - written);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			// the client is gone
+			return;
+		}
+		written += count;
+	}
+}
@@ -0,0 +1,44 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SERVER_H
+#define SERVER_H
+#include <map>
+#include <string>
+#include <vector>
+
+// translates a formula with options parsed by parse_arguments, prints to std::cout and returns the exit code
+typedef int (*translate_function)(std::map<std::string, std::string>& args);
+
+// runs the translator as a server listening on the Unix socket socket_path
+// each connection carries one request: arguments of ltl2sdba, one per line, ended by an empty line
+// or by closing the writing side; the response is the exit code on the first line, followed
+// by the output of the translation
+// after max_requests requests the server replaces itself by a fresh process (using argv)
+// that keeps listening on the same socket, which bounds the memory held by BDDs and caches
+int run_server(std::string socket_path, unsigned max_requests, char* argv[], translate_function translate);
+
+// reads one request from the connection fd into args, returns false on a read error
+// or if the request is not complete within the timeout
+bool read_request(int fd, std::vector<std::string>& args);
+
+// writes the whole string to the connection fd
+void write_response(int fd, const std::string& response);
+
+#endif
@@ -0,0 +1,127 @@
+#!/bin/sh
+#    Copyright (c) 2018 Michal Románek
+#
+#    This file is part of LTL2SDBA.
+#
+#    LTL2SDBA is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    LTL2SDBA is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+
+# translates each formula with the given options and checks that the SDBA is equivalent
+# to the automaton of ltl2tgba; needs ltl2tgba and autfilt of Spot, run by make check
+
+ltl2sdba=${LTL2SDBA:-./ltl2sdba}
+reference=$(mktemp)
+assumed=$(mktemp)
+output=$(mktemp)
+trap 'rm -f "$reference" "$assumed" "$output"' EXIT
+failed=0
+
+# each line has options, a formula and optionally an assumption (--assume), separated by semicolons as
+# the formulae contain |; with an assumption both automata are only compared on the words satisfying it;
+# lines starting with # are comments, with -o bin the output is read back by -L
+while IFS=';' read -r options formula assumption; do
+	case $options in
+		\#*) continue ;;
+	esac
+
+	if [ -z "$assumption" ]; then
+		ltl2tgba -f "$formula" > "$reference" || exit 2
+		$ltl2sdba $options -f "$formula" > "$output"
+	else
+		ltl2tgba -f "($formula) & G($assumption)" > "$reference" || exit 2
+		ltl2tgba -f "G($assumption)" > "$assumed" || exit 2
+		$ltl2sdba $options --assume "$assumption" -f "$formula" > "$output"
+	fi
+
+	case " $options " in
+		*" -o bin "*) $ltl2sdba -L "$output" ;;
+		*) cat "$output" ;;
+	esac | if [ -z "$assumption" ]; then cat; else autfilt --product="$assumed"; fi \
+		| autfilt -q --equivalent-to="$reference"
+
+	if [ $? -ne 0 ]; then
+		echo "FAIL: $ltl2sdba $options${assumption:+ --assume '$assumption'} -f '$formula'"
+		failed=1
+	fi
+done <<'FORMULAE'
+-F1 -s0;(b | d) U (G b | (d & X G b))
+-F1 -s0;a U (G b | (c & X G b))
+-F1;(a | b) U (G a | X G b)
+;G a;c -> a
+;G (b -> X a) & F c;(d -> c) & !(a & b)
+-w1;G (a -> X b)
+-w1;G (a | X (b & X c))
+-w1;F (a & X b)
+-w1;F a | F (b & X c)
+-w0;G (a -> X b)
+-C1;G F a & G F b & F G c
+-C1;G (a -> F b) & F G c & G (d | X e)
+-C1 -g1;G F a & G F b & G (c -> X F d)
+-D1;G (a -> X F b) | F G (c & X d) | G F (a & X X b)
+-D1 -g1;(G F a & G F b & G (c -> X d)) | (F G e & F (d & X X X c))
+-D1 -g1;(G F a & G F b & G F c & F d) | G (a -> X (b U (c & X d)))
+-M1 -s0;(a U (b & X 1)) | G F (c & X 1)
+-M0;G (a -> F b) & G (c -> F b)
+-M1;G (a -> F b) & G (c -> F b)
+# configurations of the native alternation removal
+;(a U b) R (c U d)
+;G F a -> G F b
+;G (a -> X (b U c)) & F G d
+# the Qmay filter with reachability closures
+;F G (a | X b) & G F c
+;G (a U (b R c)) | F G d
+# guards as truth tables (up to 16 APs) and as BDDs (above)
+;G ((a & !b) -> X (c | !d)) & G F (a & b)
+;G (p0 -> F (p1 & p2)) & G F (p3 | p4 | p5) & F G (p6 -> X (p7 & p8)) & G (p9 | p10 | p11 | p12 | p13 | p14 | p15 | X p16)
+# the flattened VWAA: states with many edges, destinations and loops
+;G (a -> X X b) & F G (c | d)
+;G ((a U b) | (c R X d))
+# the successor cache over (R, phi, letter class)
+;G F a & G F b & F G (c -> X c)
+;G (a -> F b) & G (b -> F a) & F G c
+# merging of G and F subformulae
+-G1;G (a & F b & X G F c)
+-G1;a U (b | G F c)
+-G2;F (a | F G b) & G (c & G F d)
+-G2;F (a U b) & G (c R d)
+# generalized Büchi with one mark per obligation group
+-g1;G F a & G F b & G F c
+-g1;G (a -> F b) & G (c -> F d) & F G e
+# minimization of the deterministic part
+;G (a -> F (b & X c)) & G F d
+;G F (a & X a) | G F (b & X b)
+# antichains of configurations as phis
+-A1;G F a & F G (b | X c)
+-A1;G (a -> X (b U c)) & G F d
+-A1 -g1;G (a -> F b) & G (c -> F d)
+# dynamic reordering of the BDD variables of VWAA states
+-r1;G (a -> F b) & G (c -> F d) & G (e -> F f)
+-r1 -A1;G F a & G F b & F G (c | X d)
+# edges of several letter classes joined by the accumulator
+;G (a -> X b) & G F (c & X d)
+;G F (a | b | c) & G (a -> X !a)
+# scratch edges of the products with alpha-merging
+-F1 -s0;(a | b) U (c & X (a U d))
+-F1 -s0;(a U (b & G c)) | (d U (G c & X e))
+# no names of states
+--no-names;G F a & F G b
+--no-names;a U (b & X (c R d))
+# deep nesting and shared subformulae for the iterative builder
+;a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U (a U (b U c)))))))))))))))))))))))))))))))))))))))
+;G F a & X G F a & F (G F a & b)
+# the binary format read back by -L
+-o bin;G F a & F G (b | X c)
+-o bin --no-names;(a U b) R (c U X d)
+FORMULAE
+
+exit $failed
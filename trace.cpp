@@ -0,0 +1,181 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include "trace.hpp"
+
+namespace trace {
+	unsigned level = 0;
+	unsigned categories = ALL;
+
+	// the description of the current sink, so that a server does not reopen it for each request
+	static std::string sink_name = "stderr";
+	static std::ofstream sink_file;
+	static bool json = false;
+	static bool json_first = true;
+	static const auto start = std::chrono::steady_clock::now();
+
+	static const char* category_name(unsigned cat) {
+		switch (cat) {
+			case VWAA: return "vwaa";
+			case CONF: return "conf";
+			case RCOMP: return "rcomp";
+			case SUCC: return "succ";
+			case MT: return "mt";
+			default: return "all";
+		}
+	}
+
+	// the server redirects std::cerr into its responses, std::clog stays on the terminal
+	static std::ostream& out() {
+		if (sink_file.is_open()) {
+			return sink_file;
+		}
+		return std::clog;
+	}
+
+	static void close_json() {
+		if (json && sink_file.is_open()) {
+			sink_file << "\n]\n";
+			sink_file.close();
+		}
+	}
+
+	static void json_event(const char* phase, unsigned cat, const std::string& name) {
+		long long ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+		sink_file << (json_first ? "\n" : ",\n");
+		json_first = false;
+
+		sink_file << "{\"name\":\"";
+		for (char c : name) {
+			if (c == '"' || c == '\\') {
+				sink_file << '\\' << c;
+			} else if (c == '\n') {
+				sink_file << "\\n";
+			} else if ((unsigned char) c >= 0x20) {
+				sink_file << c;
+			}
+		}
+		sink_file << "\",\"cat\":\"" << category_name(cat) << "\",\"ph\":\"" << phase
+			<< "\",\"ts\":" << ts << ",\"pid\":" << getpid() << ",\"tid\":0";
+		if (phase[0] == 'i') {
+			sink_file << ",\"s\":\"t\"";
+		}
+		sink_file << '}';
+	}
+
+	bool configure(unsigned lvl, const std::string& cats, const std::string& sink) {
+		level = lvl;
+
+		if (cats.empty() || cats == "all") {
+			categories = ALL;
+		} else {
+			categories = 0;
+			std::istringstream names(cats);
+			std::string name;
+			while (std::getline(names, name, ',')) {
+				unsigned cat = 1;
+				while (cat < ALL && name != category_name(cat)) {
+					cat <<= 1;
+				}
+				if (cat >= ALL) {
+					std::cerr << "Unknown trace category " << name << ".\n";
+					return false;
+				}
+				categories |= cat;
+			}
+		}
+
+		std::string new_sink = sink.empty() ? "stderr" : sink;
+		if (new_sink == sink_name) {
+			return true;
+		}
+
+		close_json();
+		sink_file.close();
+		json = false;
+		sink_name = new_sink;
+
+		if (new_sink == "stderr") {
+			return true;
+		}
+
+		std::string::size_type colon = new_sink.find(':');
+		std::string kind = new_sink.substr(0, colon);
+		if (colon == std::string::npos || (kind != "log" && kind != "json")) {
+			std::cerr << "Unknown trace sink " << new_sink << ".\n";
+			sink_name = "stderr";
+			return false;
+		}
+
+		sink_file.open(new_sink.substr(colon + 1), std::ofstream::trunc);
+		if (!sink_file.is_open()) {
+			std::cerr << "Unable to open the trace file " << new_sink.substr(colon + 1) << ".\n";
+			sink_name = "stderr";
+			return false;
+		}
+
+		if (kind == "json") {
+			// the array is closed when the program exits, Chrome also accepts it unclosed
+			json = true;
+			json_first = true;
+			sink_file << '[';
+			static bool registered = false;
+			if (!registered) {
+				registered = true;
+				std::atexit(close_json);
+			}
+		}
+
+		return true;
+	}
+
+	void message(unsigned cat, unsigned lvl, const std::string& text) {
+		if (json) {
+			json_event("i", cat, text);
+		} else {
+			out() << '[' << category_name(cat) << ':' << lvl << "] " << text << '\n';
+		}
+	}
+
+	scope::scope(unsigned cat, const char* name) : cat(cat), name(name), active(enabled(cat, 1)) {
+		if (active) {
+			if (json) {
+				json_event("B", cat, name);
+			} else {
+				out() << '[' << category_name(cat) << ":1] begin " << name << '\n';
+			}
+		}
+	}
+
+	scope::~scope() {
+		if (active) {
+			if (json) {
+				json_event("E", cat, name);
+			} else {
+				out() << '[' << category_name(cat) << ":1] end " << name << '\n';
+			}
+		}
+	}
+}
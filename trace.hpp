@@ -0,0 +1,90 @@
+/*
+    Copyright (c) 2018 Michal Románek
+
+    This file is part of LTL2SDBA.
+
+    LTL2SDBA is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LTL2SDBA is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+#include <sstream>
+#include <string>
+
+// Tracing of the translation. The TRACE and TRACE_SCOPE macros expand to nothing unless
+// the program is compiled with LTL2SDBA_TRACE defined (make TRACE=1), so the release build
+// pays nothing for them. With tracing compiled in, a message is written only if its level
+// is at most the level chosen by -b and its category is chosen by -c.
+//
+// levels: 1 = one message per configuration or R-component,
+//         2 = one message per state and letter,
+//         3 = everything down to single edges of the VWAA
+
+namespace trace {
+	enum category : unsigned {
+		VWAA = 1,		// classification of the VWAA states (Qmay, Qmust, t)
+		CONF = 2,		// configurations of the nondeterministic part
+		RCOMP = 4,		// choice of R and the entry into R-components
+		SUCC = 8,		// successors and breakpoints in the deterministic part
+		MT = 16,		// the modified transition relation (getqSuccs)
+		ALL = 31
+	};
+
+	// the chosen level (0 = off) and the mask of chosen categories
+	extern unsigned level;
+	extern unsigned categories;
+
+	// sets the level, the categories (comma-separated names: vwaa, conf, rcomp, succ, mt or all)
+	// and the sink: "stderr", "log:FILE" or "json:FILE" for the Chrome trace event format;
+	// returns false and prints a message for an unknown category or an unwritable file
+	bool configure(unsigned lvl, const std::string& cats, const std::string& sink);
+
+	inline bool enabled(unsigned cat, unsigned lvl) {
+		return lvl <= level && (categories & cat) != 0;
+	}
+
+	// writes one message into the sink
+	void message(unsigned cat, unsigned lvl, const std::string& text);
+
+	// marks the beginning and the end of a span (a duration event in the JSON sink)
+	class scope {
+		unsigned cat;
+		const char* name;
+		bool active;
+	public:
+		scope(unsigned cat, const char* name);
+		~scope();
+	};
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef LTL2SDBA_TRACE
+// msg is anything that can follow <<, it is evaluated only if the message is written
+#define TRACE(cat, lvl, msg) \
+	do { \
+		if (trace::enabled(trace::cat, lvl)) { \
+			std::ostringstream trace_text; \
+			trace_text << msg; \
+			trace::message(trace::cat, lvl, trace_text.str()); \
+		} \
+	} while (0)
+#define TRACE_SCOPE(cat, name) trace::scope TRACE_CONCAT(trace_scope_, __LINE__)(trace::cat, name)
+#else
+#define TRACE(cat, lvl, msg) do {} while (0)
+#define TRACE_SCOPE(cat, name) do {} while (0)
+#endif
+
+#endif
@@ -18,38 +18,35 @@
     along with LTL2SDBA.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <memory>
+#include <spot/tl/apcollect.hh>
+#include <spot/twa/formula2bdd.hh>
 #include "utils.hpp"
 
 std::set<std::set<spot::formula>> f_bar(spot::formula f) {
 	std::set<std::set<spot::formula> > r;
 	if (f.is(spot::op::And)) {
-		std::set<std::set<spot::formula> > r1 = f_bar(f[0]);
-		// f can be of a format f_0 & f_1 & ... & f_n and we don't know the precise number of operands
-		// the solution is to build an equivalent formula f_0 & (f_1 & ... & f_n)
-		// building f_0 & (f_1) is safe as Spot doesn't consider (f_1) to be an And formula
-		std::vector<spot::formula> other_operands;
-		for (unsigned int i = 1, s = f.size(); i < s; ++i) {
-			other_operands.push_back(f[i]);
-		}
-		std::set<std::set<spot::formula> > r2 = f_bar(spot::formula::And(other_operands));
-		for (std::set<std::set<spot::formula> >::iterator i1 = r1.begin(); i1 != r1.end(); ++i1) {
-			for (std::set<std::set<spot::formula> >::iterator i2 = r2.begin(); i2 != r2.end(); ++i2) {
-				// add union of *i1 and *i2 into r
-				std::set<spot::formula> s;
-				s.insert(i1->begin(), i1->end());
-				s.insert(i2->begin(), i2->end());
-				r.insert(s);
+		// the DNF of f_0 & ... & f_n is built one operand at a time, each clause of the DNF
+		// of f_0 & ... & f_i is joined with each clause of the DNF of f_(i+1)
+		r.insert(std::set<spot::formula>());
+		for (unsigned int i = 0, s = f.size(); i < s; ++i) {
+			std::set<std::set<spot::formula> > ri = f_bar(f[i]);
+			std::set<std::set<spot::formula> > product;
+			for (auto& c1 : r) {
+				for (auto& c2 : ri) {
+					// add union of c1 and c2 into the product
+					std::set<spot::formula> c = c1;
+					c.insert(c2.begin(), c2.end());
+					product.insert(c);
+				}
 			}
+			r.swap(product);
 		}
 	} else if (f.is(spot::op::Or)) {
-		std::set<std::set<spot::formula> > r1 = f_bar(f[0]);
-		std::vector<spot::formula> other_operands;
-		for (unsigned int i = 1, s = f.size(); i < s; ++i) {
-			other_operands.push_back(f[i]);
+		for (unsigned int i = 0, s = f.size(); i < s; ++i) {
+			std::set<std::set<spot::formula> > ri = f_bar(f[i]);
+			r.insert(ri.begin(), ri.end());
 		}
-		std::set<std::set<spot::formula> > r2 = f_bar(spot::formula::Or(other_operands));
-		r.insert(r1.begin(), r1.end());
-		r.insert(r2.begin(), r2.end());
 	} else {
 		std::set<spot::formula> s;
 		s.insert(f);
@@ -65,24 +62,48 @@ std::map<std::string, std::string> parse_arguments(int argc, char * argv[]) {
 	// the first value in a vector is the default one
 	std::map<std::string, std::vector<std::string>> allowed_values = {
 		{"a", { "0", "2", "3" }},
-		{"b", { "0", "1" }},
+		{"A", { "0", "1" }},
+		{"b", { "0", "1", "2", "3" }},
+		{"C", { "0", "1" }},
+		{"D", { "0", "1" }},
 		{"d", { "1", "0" }},
 		{"e", { "2", "0", "1" }},
+		{"F", { "0", "1" }},
+		{"g", { "0", "1" }},
+		{"G", { "0", "1", "2" }},
 		{"i", { "0", "1" }},
 		{"m", { "0", "1" }},
+		{"M", { "1", "0" }},
 		{"n", { "1", "0" }},
-		{"o", { "hoa", "dot" }},
+		{"no-names", { "0", "1" }},
+		{"o", { "hoa", "dot", "bin" }},
 		{"p", { "2", "1", "3" }},
+		{"r", { "0", "1" }},
 		{"s", { "1", "0" }},
 		{"t", { "1", "0" }},
 		{"u", { "1", "0" }},
+		{"w", { "0", "1" }},
 		{"X", { "0", "1" }},
+		{"y", { "0", "1" }},
 		{"z", { "1", "0" }},
 	};
 
+	// long options taking a value and long flags, which are set to 1
+	std::set<std::string> long_options = { "assume" };
+	std::set<std::string> long_flags = { "no-names" };
+
 	for (int i = 1; i < argc; ++i) {
 		if (last_arg_name.empty()) {
-			if (argv[i][0] == '-') {
+			if (argv[i][0] == '-' && argv[i][1] == '-') {
+				last_arg_name.assign(argv[i] + 2);
+				if (long_flags.count(last_arg_name) > 0) {
+					result[last_arg_name] = "1";
+					last_arg_name.clear();
+				} else if (long_options.count(last_arg_name) == 0) {
+					result.clear();
+					break;
+				}
+			} else if (argv[i][0] == '-') {
 				last_arg_name.assign(argv[i]);
 				last_arg_name.erase(0, 1); // remove -
 
@@ -116,7 +137,7 @@ std::map<std::string, std::string> parse_arguments(int argc, char * argv[]) {
 	}
 
 	// simulation of LTL2BA means default values -d0 -u0 -X0 -n0
-	// simulating LTL3BA means -u0 -i1 -X1 -n1
+	// simulating LTL3BA means -u0 -i1 -X1 -n1 -F1
 	if (result.count("a") > 0) {
 		std::set<std::string> params_default_null;
 		std::set<std::string> params_default_true;
@@ -126,7 +147,7 @@ std::map<std::string, std::string> parse_arguments(int argc, char * argv[]) {
 			allowed_values["e"] = { "1", "0", "2" };
 		} else if (result["a"] == "3") {
 			params_default_null = { "u", "n" };
-			params_default_true = { "i", "X" };
+			params_default_true = { "i", "X", "F" };
 		}
 
 		for (auto param : params_default_null) {
@@ -153,5 +174,28 @@ std::map<std::string, std::string> parse_arguments(int argc, char * argv[]) {
 		}
 	}
 
+	// the number of requests of -R has no list of values, it has to be a number that fits into unsigned
+	if (result.count("R") > 0) {
+		auto& requests = result["R"];
+		if (requests.empty() || requests.size() > 9
+			|| requests.find_first_not_of("0123456789") != std::string::npos) {
+			result.clear();
+		}
+	}
+
+	return result;
+}
+
+bdd assumption_bdd(const spot::bdd_dict_ptr& dict, const std::vector<spot::formula>& aps, const void* owner) {
+	bdd result = spot::formula_to_bdd(o_assume, dict, owner);
+
+	std::set<spot::formula> known(aps.begin(), aps.end());
+	std::unique_ptr<spot::atomic_prop_set> assumed(spot::atomic_prop_collect(o_assume));
+	for (auto& ap : *assumed) {
+		if (known.count(ap) == 0) {
+			result = bdd_exist(result, bdd_ithvar(dict->varnum(ap)));
+		}
+	}
+
 	return result;
 }
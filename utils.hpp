@@ -29,24 +29,40 @@
 #include <queue>
 #include <bddx.h>
 #include <spot/tl/parse.hh>
+#include <spot/twa/bdddict.hh>
 #include <spot/tl/simplify.hh>
 
 extern bool o_single_init_state;	// -i
 extern bool o_vwaa_determ;			// -d
 extern unsigned o_eq_level;			// -e
+extern bool o_merge_vwaa;			// -M
 extern bool o_mergeable_info;		// -m
 extern bool o_ac_filter_fin;		// -t
 extern bool o_spot_simulation;		// -u
 extern bool o_spot_scc_filter;		// -z
+extern bool o_stats;				// -y
+extern bool o_gen_buchi;			// -g
+extern bool o_antichains;			// -A
+extern bool o_reorder;				// -r
+extern bool o_compose;				// -C
+extern bool o_decompose;			// -D
+extern bool o_weak_fragments;		// -w
 
 extern unsigned o_u_merge_level;	// -F
 extern unsigned o_g_merge_level;	// -G
 extern bool o_x_single_succ;		// -X
+extern spot::formula o_assume;		// --assume
+extern bool o_no_names;				// --no-names
 
-// returns the DNF representation of LTL formula f
+// returns the DNF representation of LTL formula f, it recurses only into nested And and Or
+// (Spot keeps the operands of And and Or flat), not into temporal operators
 std::set<std::set<spot::formula>> f_bar(spot::formula f);
 
-// parses arguments from argv
+// parses arguments from argv, a long option --name takes the next argument as its value
 std::map<std::string, std::string> parse_arguments(int argc, char* argv[]);
 
+// returns the BDD of o_assume over the atomic propositions aps (registered in dict for owner),
+// the other atomic propositions of o_assume are quantified existentially
+bdd assumption_bdd(const spot::bdd_dict_ptr& dict, const std::vector<spot::formula>& aps, const void* owner);
+
 #endif